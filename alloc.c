@@ -0,0 +1,166 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <time.h>
+#include <stdlib.h>
+#include "alloc.h"
+
+const char * tag_names[TAGS] =
+{
+   "ast", "parser", "symbol", "types", "input"
+};
+
+__thread alloc_stats_t * alloc_stats;
+
+alloc_stats_t * alloc_list = NULL;
+pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* collections, timed by the collector's event callback */
+long gc_pauses = 0;
+double gc_pause_total = 0, gc_pause_max = 0, gc_pause_start;
+
+void alloc_note(alloc_tag tag, size_t n)
+{
+   alloc_stats_t * s = alloc_stats;
+
+   if (s == NULL)
+   {
+      /* never freed, as the counts outlive the thread */
+      s = (alloc_stats_t *) calloc(1, sizeof(alloc_stats_t));
+
+      pthread_mutex_lock(&alloc_lock);
+      s->next = alloc_list;
+      alloc_list = s;
+      pthread_mutex_unlock(&alloc_lock);
+
+      alloc_stats = s;
+   }
+
+   s->count[tag]++;
+   s->bytes[tag] += n;
+}
+
+double gc_clock(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t);
+
+   return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+void gc_event(GC_EventType e)
+{
+   double t;
+
+   if (e == GC_EVENT_START)
+      gc_pause_start = gc_clock();
+   else if (e == GC_EVENT_END)
+   {
+      t = gc_clock() - gc_pause_start;
+
+      gc_pauses++;
+      gc_pause_total += t;
+      if (t > gc_pause_max)
+         gc_pause_max = t;
+   }
+}
+
+/* the number of tagged allocations so far, on all threads */
+long alloc_count(void)
+{
+   alloc_stats_t * s;
+   long n = 0;
+   int i;
+
+   pthread_mutex_lock(&alloc_lock);
+
+   for (s = alloc_list; s; s = s->next)
+      for (i = 0; i < TAGS; i++)
+         n += s->count[i];
+
+   pthread_mutex_unlock(&alloc_lock);
+
+   return n;
+}
+
+/*
+   Print the allocations made by each subsystem, on all threads, and
+   the state of the collector. Counts from threads still running may
+   be slightly out of date.
+*/
+void alloc_report(FILE * out)
+{
+   long count[TAGS] = { 0 }, bytes[TAGS] = { 0 }, tagged = 0;
+   size_t total = GC_get_total_bytes();
+   alloc_stats_t * s;
+   int i;
+
+   pthread_mutex_lock(&alloc_lock);
+
+   for (s = alloc_list; s; s = s->next)
+   {
+      for (i = 0; i < TAGS; i++)
+      {
+         count[i] += s->count[i];
+         bytes[i] += s->bytes[i];
+      }
+   }
+
+   pthread_mutex_unlock(&alloc_lock);
+
+   fprintf(out, "%-10s %12s %14s\n", "subsystem", "allocs", "bytes");
+
+   for (i = 0; i < TAGS; i++)
+   {
+      fprintf(out, "%-10s %12ld %14ld\n", tag_names[i], count[i], bytes[i]);
+      tagged += bytes[i];
+   }
+
+   fprintf(out, "%-10s %12s %14ld\n", "other", "",
+           total > tagged ? (long) total - tagged : 0L);
+
+   fprintf(out, "heap %lu bytes, %lu free, %lu allocated in total\n",
+           (unsigned long) GC_get_heap_size(),
+           (unsigned long) GC_get_free_bytes(), (unsigned long) total);
+
+   fprintf(out, "%lu collections, %ld timed, pauses %.3f ms in total, "
+           "%.3f ms at most\n", (unsigned long) GC_get_gc_no(), gc_pauses,
+           gc_pause_total*1e3, gc_pause_max*1e3);
+}
+
+void alloc_exit(void)
+{
+   alloc_report(stderr);
+}
+
+void alloc_init(void)
+{
+   GC_set_on_collection_event(gc_event);
+
+   if (getenv("CESIUM_ALLOC_STATS"))
+      atexit(alloc_exit);
+}
@@ -0,0 +1,62 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdio.h>
+#include <pthread.h>
+#include "gc.h"
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+typedef enum
+{
+   TAG_AST, TAG_PARSER, TAG_SYMBOL, TAG_TYPES, TAG_INPUT, TAGS
+} alloc_tag;
+
+typedef struct alloc_stats_t
+{
+   long count[TAGS];
+   long bytes[TAGS];
+   struct alloc_stats_t * next; /* all threads, for reporting */
+} alloc_stats_t;
+
+/*
+   Allocations counted against a subsystem. Counts are kept per thread,
+   so that threads parsing in parallel do not contend for them.
+*/
+#define ALLOC(tag, n) (alloc_note(tag, n), GC_MALLOC(n))
+
+#define ALLOC_ATOMIC(tag, n) (alloc_note(tag, n), GC_MALLOC_ATOMIC(n))
+
+void alloc_note(alloc_tag tag, size_t n);
+
+void alloc_init(void);
+
+long alloc_count(void);
+
+void alloc_report(FILE * out);
+
+#endif
@@ -0,0 +1,456 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "array.h"
+
+/*
+   Element-wise kernels work a vector at a time using the GCC vector
+   extensions, which are lowered to whatever SIMD instructions the
+   target has. Loads and stores go through memcpy, so the data need not
+   be aligned to the vector size.
+*/
+typedef long vlong __attribute__ ((vector_size (32)));
+typedef double vdouble __attribute__ ((vector_size (32)));
+
+#define VLEN(vt, t) ((long) (sizeof(vt)/sizeof(t)))
+
+#define ELEMENTWISE_KERNEL(name, t, vt, op)              \
+void name(t * r, const t * a, const t * b, long n)       \
+{                                                        \
+   long i;                                               \
+   vt x, y;                                              \
+                                                         \
+   for (i = 0; i + VLEN(vt, t) <= n; i += VLEN(vt, t))   \
+   {                                                     \
+      memcpy(&x, a + i, sizeof(vt));                     \
+      memcpy(&y, b + i, sizeof(vt));                     \
+      x = x op y;                                        \
+      memcpy(r + i, &x, sizeof(vt));                     \
+   }                                                     \
+                                                         \
+   for ( ; i < n; i++)                                   \
+      r[i] = a[i] op b[i];                               \
+}
+
+#define SUM_KERNEL(name, t, vt)                          \
+t name(const t * a, long n)                              \
+{                                                        \
+   long i, j;                                            \
+   vt x, acc = { 0 };                                    \
+   t sum = 0;                                            \
+                                                         \
+   for (i = 0; i + VLEN(vt, t) <= n; i += VLEN(vt, t))   \
+   {                                                     \
+      memcpy(&x, a + i, sizeof(vt));                     \
+      acc += x;                                          \
+   }                                                     \
+                                                         \
+   for (j = 0; j < VLEN(vt, t); j++)                     \
+      sum += acc[j];                                     \
+                                                         \
+   for ( ; i < n; i++)                                   \
+      sum += a[i];                                       \
+                                                         \
+   return sum;                                           \
+}
+
+ELEMENTWISE_KERNEL(int_add_kernel, long, vlong, +)
+ELEMENTWISE_KERNEL(int_sub_kernel, long, vlong, -)
+ELEMENTWISE_KERNEL(int_mul_kernel, long, vlong, *)
+ELEMENTWISE_KERNEL(double_add_kernel, double, vdouble, +)
+ELEMENTWISE_KERNEL(double_sub_kernel, double, vdouble, -)
+ELEMENTWISE_KERNEL(double_mul_kernel, double, vdouble, *)
+ELEMENTWISE_KERNEL(double_div_kernel, double, vdouble, /)
+
+SUM_KERNEL(int_sum_kernel, long, vlong)
+SUM_KERNEL(double_sum_kernel, double, vdouble)
+
+void int_div_kernel(long * r, const long * a, const long * b, long n)
+{
+   long i;
+
+   for (i = 0; i < n; i++)
+   {
+      if (b[i] == 0)
+         exception("Division by zero\n");
+      if (b[i] == -1 && a[i] == LONG_MIN)
+         exception("Integer overflow in division\n");
+      r[i] = a[i] / b[i];
+   }
+}
+
+int array_unboxed(type_t * el_type)
+{
+   switch (el_type->typ)
+   {
+   case INT:
+   case DOUBLE:
+   case CHAR:
+   case BOOL:
+      return 1;
+   default:
+      return 0;
+   }
+}
+
+size_t array_el_size(type_t * el_type)
+{
+   switch (el_type->typ)
+   {
+   case INT:
+      return sizeof(long);
+   case DOUBLE:
+      return sizeof(double);
+   case CHAR:
+   case BOOL:
+      return sizeof(char);
+   default:
+      return sizeof(value_t);
+   }
+}
+
+/*
+   Unboxed arrays contain no pointers, so they are allocated atomic and
+   never scanned by the collector. Their elements are not initialised.
+*/
+value_t new_array(type_t * el_type, long length)
+{
+   size_t el_size = array_el_size(el_type), size;
+   array_t * arr;
+   value_t val;
+
+   if (length < 0)
+      exception("Negative array length\n");
+
+   if ((size_t) length > (SIZE_MAX - sizeof(array_t))/el_size)
+      exception("Array too large\n");
+
+   size = sizeof(array_t) + length*el_size;
+
+   if (array_unboxed(el_type))
+      arr = (array_t *) GC_MALLOC_ATOMIC(size);
+   else
+      arr = (array_t *) GC_MALLOC(size);
+
+   if (arr == NULL)
+      exception("Out of memory allocating array\n");
+
+   arr->length = length;
+
+   val.type = array_type(el_type);
+   val.v.p = arr;
+
+   return val;
+}
+
+value_t array_get(value_t arr, long i)
+{
+   array_t * a = (array_t *) arr.v.p;
+   value_t val;
+
+   val.type = arr.type->ret;
+
+   switch (val.type->typ)
+   {
+   case INT:
+      val.v.i = ((long *) a->data)[i];
+      break;
+   case DOUBLE:
+      val.v.d = ((double *) a->data)[i];
+      break;
+   case CHAR:
+   case BOOL:
+      val.v.i = a->data[i];
+      break;
+   default:
+      val = ((value_t *) a->data)[i];
+   }
+
+   return val;
+}
+
+void array_set(value_t arr, long i, value_t val)
+{
+   array_t * a = (array_t *) arr.v.p;
+   type_t * el_type = arr.type->ret;
+
+   if (array_unboxed(el_type) && val.type != el_type)
+      exception("Array element of wrong type\n");
+
+   switch (el_type->typ)
+   {
+   case INT:
+      ((long *) a->data)[i] = val.v.i;
+      break;
+   case DOUBLE:
+      ((double *) a->data)[i] = val.v.d;
+      break;
+   case CHAR:
+   case BOOL:
+      a->data[i] = (char) val.v.i;
+      break;
+   default:
+      ((value_t *) a->data)[i] = val;
+   }
+}
+
+value_t array_index(value_t arr, value_t i)
+{
+   if (arr.type == NULL || arr.type->typ != ARRAY)
+      exception("Attempt to index a non-array\n");
+
+   if (i.type != t_int)
+      exception("Array index must be an int\n");
+
+   if (i.v.i < 0 || i.v.i >= ((array_t *) arr.v.p)->length)
+      exception("Array index out of bounds\n");
+
+   return array_get(arr, i.v.i);
+}
+
+value_t array_binop(tag_t op, value_t a, value_t b)
+{
+   array_t * x = (array_t *) a.v.p;
+   array_t * y = (array_t *) b.v.p;
+   long n = x->length;
+   value_t r;
+
+   if (y->length != n)
+      exception("Array lengths differ in arithmetic expression\n");
+
+   r = new_array(a.type->ret, n);
+
+   if (a.type->ret == t_int)
+   {
+      long * rd = (long *) ((array_t *) r.v.p)->data;
+      long * xd = (long *) x->data, * yd = (long *) y->data;
+
+      switch (op)
+      {
+      case T_ADD:
+         int_add_kernel(rd, xd, yd, n);
+         break;
+      case T_SUB:
+         int_sub_kernel(rd, xd, yd, n);
+         break;
+      case T_MUL:
+         int_mul_kernel(rd, xd, yd, n);
+         break;
+      case T_DIV:
+         int_div_kernel(rd, xd, yd, n);
+         break;
+      }
+   } else
+   {
+      double * rd = (double *) ((array_t *) r.v.p)->data;
+      double * xd = (double *) x->data, * yd = (double *) y->data;
+
+      switch (op)
+      {
+      case T_ADD:
+         double_add_kernel(rd, xd, yd, n);
+         break;
+      case T_SUB:
+         double_sub_kernel(rd, xd, yd, n);
+         break;
+      case T_MUL:
+         double_mul_kernel(rd, xd, yd, n);
+         break;
+      case T_DIV:
+         double_div_kernel(rd, xd, yd, n);
+         break;
+      }
+   }
+
+   return r;
+}
+
+value_t array_add(value_t a, value_t b)
+{
+   return array_binop(T_ADD, a, b);
+}
+
+value_t array_sub(value_t a, value_t b)
+{
+   return array_binop(T_SUB, a, b);
+}
+
+value_t array_mul(value_t a, value_t b)
+{
+   return array_binop(T_MUL, a, b);
+}
+
+value_t array_div(value_t a, value_t b)
+{
+   return array_binop(T_DIV, a, b);
+}
+
+void check_array(value_t arr)
+{
+   if (arr.type == NULL || arr.type->typ != ARRAY)
+      exception("Array expected\n");
+}
+
+value_t array_fn(value_t * args)
+{
+   value_t arr;
+   long i, n;
+
+   if (args[0].type != t_int)
+      exception("Array length must be an int\n");
+
+   n = args[0].v.i;
+   arr = new_array(args[1].type, n);
+
+   if (args[1].type == t_int)
+   {
+      long * d = (long *) ((array_t *) arr.v.p)->data;
+      for (i = 0; i < n; i++)
+         d[i] = args[1].v.i;
+   } else if (args[1].type == t_double)
+   {
+      double * d = (double *) ((array_t *) arr.v.p)->data;
+      for (i = 0; i < n; i++)
+         d[i] = args[1].v.d;
+   } else
+   {
+      for (i = 0; i < n; i++)
+         array_set(arr, i, args[1]);
+   }
+
+   return arr;
+}
+
+value_t iota_fn(value_t * args)
+{
+   value_t arr;
+   long * d;
+   long i;
+
+   if (args[0].type != t_int)
+      exception("Array length must be an int\n");
+
+   arr = new_array(t_int, args[0].v.i);
+   d = (long *) ((array_t *) arr.v.p)->data;
+
+   for (i = 0; i < args[0].v.i; i++)
+      d[i] = i;
+
+   return arr;
+}
+
+value_t length_fn(value_t * args)
+{
+   value_t val;
+
+   check_array(args[0]);
+
+   val.type = t_int;
+   val.v.i = ((array_t *) args[0].v.p)->length;
+
+   return val;
+}
+
+value_t sum_fn(value_t * args)
+{
+   array_t * arr;
+   value_t val;
+
+   check_array(args[0]);
+   arr = (array_t *) args[0].v.p;
+
+   val.type = args[0].type->ret;
+
+   if (val.type == t_int)
+      val.v.i = int_sum_kernel((long *) arr->data, arr->length);
+   else if (val.type == t_double)
+      val.v.d = double_sum_kernel((double *) arr->data, arr->length);
+   else
+      exception("Sum of non-numeric array\n");
+
+   return val;
+}
+
+value_t copy_fn(value_t * args)
+{
+   array_t * arr;
+   value_t val;
+
+   check_array(args[0]);
+   arr = (array_t *) args[0].v.p;
+
+   val = new_array(args[0].type->ret, arr->length);
+   memcpy(((array_t *) val.v.p)->data, arr->data,
+          arr->length*array_el_size(args[0].type->ret));
+
+   return val;
+}
+
+void print_array(value_t arr)
+{
+   array_t * a = (array_t *) arr.v.p;
+   long i;
+
+   printf("[");
+
+   for (i = 0; i < a->length && i < 10; i++)
+   {
+      if (i)
+         printf(", ");
+      print_value(array_get(arr, i));
+   }
+
+   if (a->length > 10)
+      printf(", ...");
+
+   printf("]");
+}
+
+void array_init(void)
+{
+   type_t * num[2];
+   type_t * t;
+   int i;
+
+   num[0] = t_int;
+   num[1] = t_double;
+
+   for (i = 0; i < 2; i++)
+   {
+      t = array_type(num[i]);
+
+      method_add(T_ADD, t, t, array_add);
+      method_add(T_SUB, t, t, array_sub);
+      method_add(T_MUL, t, t, array_mul);
+      method_add(T_DIV, t, t, array_div);
+   }
+
+   global_define(sym_lookup("array"), native_value(array_fn, 2));
+   global_define(sym_lookup("iota"), native_value(iota_fn, 1));
+   global_define(sym_lookup("length"), native_value(length_fn, 1));
+   global_define(sym_lookup("sum"), native_value(sum_fn, 1));
+   global_define(sym_lookup("copy"), native_value(copy_fn, 1));
+}
@@ -30,7 +30,7 @@ ast_t * ast_nil;
 
 ast_t * new_ast()
 {
-   ast_t * ast = GC_MALLOC(sizeof(ast_t));
+   ast_t * ast = ALLOC(TAG_AST, sizeof(ast_t));
       
    return ast;
 }
@@ -25,26 +25,47 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "gc.h"
+#include "alloc.h"
 #include "symbol.h"
+#include "value.h"
 
 #ifndef AST_H
 #define AST_H
 
+/* nodes are cached by module.c, so changes need a new MODULE_VERSION */
 typedef enum
 {
-   T_NONE, T_LIST, T_INT, T_ADD, T_SUB, T_MUL, T_DIV, T_REM, T_IDENT
+   T_NONE, T_LIST, T_INT, T_DOUBLE, T_ADD, T_SUB, T_MUL, T_DIV, T_REM, T_IDENT,
+   T_ASSIGN, T_LAMBDA, T_PARAMS, T_CALL, T_ARGS, T_CAPTURES, T_ARRAY,
+   T_INDEX, T_DATATYPE, T_SLOT, T_EXTERN, T_IF, T_IMPORT
 } tag_t;
 
+typedef enum
+{
+   LOC_LOCAL, LOC_CAPTURED, LOC_GLOBAL
+} loc_t;
+
 typedef struct ast_t
 {
    tag_t typ;
    struct ast_t * child;
    struct ast_t * next;
    sym_t * sym;
+   loc_t loc; /* where a resolved identifier lives */
+   int slot; /* slot in frame or closure, or frame size for lambdas */
+   value_t val; /* constant value, once known */
+   struct type_t * type; /* static type, once known */
+   struct spec_t * spec; /* specialised instances, for lambdas */
+   struct ic_t * ic; /* inline cache, for overloaded operators */
+   int tail; /* call is in tail position */
+   int start; /* span of source, for statements parsed incrementally */
+   int end;
 } ast_t;
 
 ast_t * new_ast();
 
+void ast_init();
+
 ast_t * ast1(tag_t typ, ast_t * a1);
 
 ast_t * ast2(tag_t typ, ast_t * a1, ast_t * a2);
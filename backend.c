@@ -24,6 +24,334 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 
+#include <alloca.h>
 #include "backend.h"
+#include "array.h"
+#include "layout.h"
+#include "ffi.h"
+#include "module.h"
 
+value_t nil_value(void)
+{
+   value_t val;
+   val.type = t_nil;
+   val.v.p = NULL;
+   return val;
+}
 
+value_t native_value(native_fn fn, int arity)
+{
+   type_t ** args = (type_t **) GC_MALLOC(arity*sizeof(type_t *));
+   value_t val;
+   int i;
+
+   for (i = 0; i < arity; i++)
+      args[i] = new_typevar();
+
+   val.type = fn_type(new_typevar(), arity, args);
+   val.v.p = (void *) fn;
+
+   return val;
+}
+
+/*
+   Evaluate an expression which a specialised body has shown to be of
+   type int, without boxing intermediate results or checking types.
+*/
+long eval_int(frame_t * frame, ast_t * ast)
+{
+   long a, b;
+
+   switch (ast->typ)
+   {
+   case T_INT:
+      return ast->val.v.i;
+   case T_IDENT:
+      /* a global is only typed while its version is unchanged */
+      if (ast->loc == LOC_GLOBAL)
+         return ast->sym->val.v.i;
+      return frame->slots[ast->slot].v.i;
+   case T_LIST:
+      return eval_int(frame, ast->child);
+   case T_ADD:
+      return eval_int(frame, ast->child) + eval_int(frame, ast->child->next);
+   case T_SUB:
+      return eval_int(frame, ast->child) - eval_int(frame, ast->child->next);
+   case T_MUL:
+      return eval_int(frame, ast->child) * eval_int(frame, ast->child->next);
+   case T_DIV:
+   case T_REM:
+      a = eval_int(frame, ast->child);
+      b = eval_int(frame, ast->child->next);
+      if (b == 0)
+         exception("Division by zero\n");
+      if (b == -1)
+      {
+         /* LONG_MIN / -1 overflows, and traps, as does its remainder */
+         if (ast->typ == T_REM)
+            return 0;
+         if (a == LONG_MIN)
+            exception("Integer overflow in division\n");
+      }
+      return ast->typ == T_DIV ? a / b : a % b;
+   default:
+      return eval(frame, ast).v.i;
+   }
+}
+
+value_t apply_native(value_t fn, value_t * vals)
+{
+   if (fn.type->stub)
+      return ffi_call(fn, vals);
+
+   if (fn.v.p == NULL)
+      return new_record(fn.type->ret, vals);
+
+   return ((native_fn) fn.v.p)(vals);
+}
+
+/*
+   A call in tail position does not call the lambda itself. It leaves
+   the callee and arguments here and returns a marker, and the loop in
+   apply makes the call once the caller's frame is finished with. So
+   tail calls, including mutually recursive ones, run in constant stack.
+*/
+static type_t tail_marker;
+
+static __thread value_t tail_fn;
+
+static __thread value_t * tail_args;
+
+static __thread int tail_size;
+
+value_t apply(value_t fn, value_t * vals)
+{
+   value_t * slots = NULL;
+   int size = 0;
+   closure_t * cl;
+   ast_t * lambda;
+   frame_t f;
+   value_t r;
+
+   while (1)
+   {
+      cl = (closure_t *) fn.v.p;
+      lambda = cl->lambda;
+
+      /* the frame is reused, only growing if a callee needs more slots */
+      if (lambda->slot > size)
+      {
+         size = lambda->slot;
+         slots = (value_t *) alloca(size*sizeof(value_t));
+      }
+
+      memcpy(slots, vals, fn.type->arity*sizeof(value_t));
+      f.slots = slots;
+      f.env = cl->env;
+
+      r = eval(&f, specialise(lambda, f.slots));
+
+      if (r.type != &tail_marker)
+         return r;
+
+      fn = tail_fn;
+      vals = tail_args;
+   }
+}
+
+value_t * eval_args(frame_t * frame, value_t fn, ast_t * args, value_t * vals)
+{
+   int i;
+
+   for (i = 0; args && i < fn.type->arity; args = args->next, i++)
+      vals[i] = eval(frame, args);
+
+   if (args || i != fn.type->arity)
+      exception("Wrong number of arguments in function call\n");
+
+   return vals;
+}
+
+value_t call(frame_t * frame, value_t fn, ast_t * args)
+{
+   value_t * vals;
+
+   if (fn.type == NULL || (fn.type->typ != LAMBDA && fn.type->typ != FN))
+      exception("Attempt to call a non-function\n");
+
+   vals = (value_t *) alloca(fn.type->arity*sizeof(value_t));
+   eval_args(frame, fn, args, vals);
+
+   if (fn.type->typ == FN)
+      return apply_native(fn, vals);
+
+   return apply(fn, vals);
+}
+
+value_t tail_call(frame_t * frame, value_t fn, ast_t * args)
+{
+   value_t * vals;
+   value_t val;
+
+   if (fn.type == NULL || (fn.type->typ != LAMBDA && fn.type->typ != FN))
+      exception("Attempt to call a non-function\n");
+
+   /* the arguments may make calls of their own, which reuse tail_args */
+   vals = (value_t *) alloca(fn.type->arity*sizeof(value_t));
+   eval_args(frame, fn, args, vals);
+
+   if (fn.type->typ == FN)
+      return apply_native(fn, vals);
+
+   /* the collector need not scan thread locals, so this is uncollectable */
+   if (fn.type->arity > tail_size)
+   {
+      GC_FREE(tail_args);
+      tail_size = fn.type->arity;
+      tail_args = (value_t *) GC_MALLOC_UNCOLLECTABLE(tail_size*sizeof(value_t));
+   }
+
+   memcpy(tail_args, vals, fn.type->arity*sizeof(value_t));
+   tail_fn = fn;
+
+   val.type = &tail_marker;
+   val.v.p = NULL;
+
+   return val;
+}
+
+value_t eval(frame_t * frame, ast_t * ast)
+{
+   value_t val, arr;
+   closure_t * cl;
+   ast_t * a;
+   int i;
+
+   switch (ast->typ)
+   {
+   case T_INT:
+   case T_DOUBLE:
+      return ast->val;
+   case T_IDENT:
+      if (ast->loc == LOC_LOCAL)
+         val = frame->slots[ast->slot];
+      else if (ast->loc == LOC_CAPTURED)
+         val = frame->env[ast->slot];
+      else
+      {
+         val = ast->sym->val;
+         if (val.type == NULL)
+            unknown_ident(ast->sym);
+      }
+      return val;
+   case T_ADD:
+   case T_SUB:
+   case T_MUL:
+   case T_DIV:
+   case T_REM:
+      if (ast->type == t_int)
+      {
+         val.type = t_int;
+         val.v.i = eval_int(frame, ast);
+         return val;
+      }
+      val = eval(frame, ast->child);
+      return dispatch(ast, val, eval(frame, ast->child->next));
+   case T_LIST:
+      return eval(frame, ast->child);
+   case T_ASSIGN:
+      a = ast->child;
+      val = eval(frame, a->next);
+      if (a->loc == LOC_GLOBAL)
+         global_define(a->sym, val);
+      else
+         frame->slots[a->slot] = val;
+      return nil_value();
+   case T_LAMBDA:
+      if (ast->val.v.p)
+         return ast->val;
+      a = ast->child->next->next;
+      cl = (closure_t *) GC_MALLOC(sizeof(closure_t) + a->slot*sizeof(value_t));
+      cl->lambda = ast;
+      for (a = a->child, i = 0; a; a = a->next, i++)
+         cl->env[i] = eval(frame, a);
+      val.type = ast->val.type;
+      val.v.p = cl;
+      return val;
+   case T_CALL:
+      val = eval(frame, ast->child);
+      for (a = ast->child->next; a; a = a->next)
+      {
+         if (a->typ == T_INDEX)
+            val = array_index(val, eval(frame, a->child));
+         else if (a->typ == T_SLOT)
+            val = record_get(val, a->child->sym);
+         else if (a->next == NULL && ast->tail)
+            return tail_call(frame, val, a->child);
+         else
+            val = call(frame, val, a->child);
+      }
+      return val;
+   case T_IF:
+      val = eval(frame, ast->child);
+      if (val.type != t_int && val.type != t_bool)
+         exception("Condition must be an int or bool\n");
+      if (val.v.i)
+         return eval(frame, ast->child->next);
+      return eval(frame, ast->child->next->next);
+   case T_ARRAY:
+      for (i = 0, a = ast->child; a; a = a->next)
+         i++;
+      if (i == 0)
+         return new_array(t_nil, 0);
+      val = eval(frame, ast->child);
+      arr = new_array(val.type, i);
+      array_set(arr, 0, val);
+      for (i = 1, a = ast->child->next; a; a = a->next, i++)
+         array_set(arr, i, eval(frame, a));
+      return arr;
+   case T_DATATYPE:
+      define_datatype(ast);
+      return nil_value();
+   case T_EXTERN:
+      define_extern(ast);
+      return nil_value();
+   case T_IMPORT:
+      module_import(ast->child->sym);
+      return nil_value();
+   default:
+      exception("Unknown AST node in eval\n");
+   }
+
+   return nil_value();
+}
+
+void print_value(value_t val)
+{
+   if (val.type == NULL || val.type == t_nil)
+      return;
+
+   switch (val.type->typ)
+   {
+   case INT:
+      printf("%ld", val.v.i);
+      break;
+   case DOUBLE:
+      printf("%.15g", val.v.d);
+      break;
+   case LAMBDA:
+      printf("<lambda>");
+      break;
+   case FN:
+      printf("<function>");
+      break;
+   case ARRAY:
+      print_array(val);
+      break;
+   case DATATYPE:
+      print_record(val);
+      break;
+   default:
+      printf("<value>");
+   }
+}
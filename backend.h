@@ -27,11 +27,20 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdio.h>
 #include "gc.h"
+#include "env.h"
+#include "spec.h"
+#include "dispatch.h"
 
 #ifndef BACKEND_H
 #define BACKEND_H
 
+typedef value_t (*native_fn)(value_t * args);
 
+value_t native_value(native_fn fn, int arity);
+
+value_t eval(frame_t * frame, ast_t * ast);
+
+void print_value(value_t val);
 
 #endif
 
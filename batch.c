@@ -0,0 +1,327 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "batch.h"
+
+/*
+   Number of workers: CESIUM_JOBS if set, otherwise one per core.
+*/
+int batch_jobs(void)
+{
+   char * env = getenv("CESIUM_JOBS");
+   long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+   return n > 0 ? n : 1;
+}
+
+int line_of(char * src, int offset)
+{
+   int line = 1, i;
+
+   for (i = 0; i < offset; i++)
+      if (src[i] == '\n')
+         line++;
+
+   return line;
+}
+
+void stmt_append(ast_t *** stmts, int * num, int * alloc, ast_t * a)
+{
+   if (*num == *alloc)
+   {
+      *alloc = *alloc*2 + 16;
+      *stmts = (ast_t **) GC_REALLOC(*stmts, *alloc*sizeof(ast_t *));
+   }
+
+   (*stmts)[(*num)++] = a;
+}
+
+/*
+   Parse one chunk speculatively. Its start may not be a real statement
+   boundary, so errors are not reported, only recorded in c->ok.
+*/
+void * parse_chunk(void * arg)
+{
+   chunk_t * c = (chunk_t *) arg;
+   input_t * in;
+   handler_t h;
+   ast_t * a;
+   int alloc = 0;
+
+   in = string_input(c->src + c->start, c->end - c->start);
+   c->stop = c->start;
+   c->ok = 0;
+
+   if (TRY(h))
+   {
+      while (a = parse(in, c->stmt))
+      {
+         stmt_append(&c->stmts, &c->num_stmts, &alloc, a);
+         c->stop = c->start + in->start;
+      }
+
+      skip_whitespace(in);
+      c->ok = (in->start >= in->length);
+
+      handler_pop(&h);
+   }
+
+   return NULL;
+}
+
+/*
+   Parse src as a sequence of statements using up to n threads, giving
+   exactly the statements a serial parse would. The source is cut into
+   chunks just after a ';', which usually ends a statement, and the
+   chunks are parsed concurrently. They are then checked in order. A
+   chunk is only used if it starts where the statements before it
+   ended. Otherwise, or if it did not parse cleanly to its end, parsing
+   continues serially from the last real boundary until it reaches the
+   start of a later chunk. *pos is the offset at which parsing stopped,
+   or of the statement being parsed if an exception is raised. If
+   parsing stopped before the end, err is set to the syntax error.
+*/
+ast_t ** parse_split(combinator_t * stmt, char * src, int len, int n,
+                                       int * num, int * pos, err_t * err)
+{
+   chunk_t * chunks = (chunk_t *) GC_MALLOC(n*sizeof(chunk_t));
+   pthread_t * threads = (pthread_t *) GC_MALLOC(n*sizeof(pthread_t));
+   int * started = (int *) GC_MALLOC(n*sizeof(int));
+   ast_t ** stmts = NULL;
+   input_t * in;
+   ast_t * a;
+   int alloc = 0, i, j, k, off;
+
+   *num = 0;
+
+   for (i = 0, k = 0; i < n; i++)
+   {
+      off = (long) len*i/n;
+      if (i > 0)
+      {
+         while (off < len && src[off] != ';')
+            off++;
+         off++;
+      }
+
+      if (off < len && (k == 0 || off > chunks[k - 1].start))
+      {
+         chunks[k].stmt = stmt;
+         chunks[k].src = src;
+         chunks[k].start = off;
+         k++;
+      }
+   }
+
+   n = k;
+   for (i = 0; i < n; i++)
+      chunks[i].end = i + 1 < n ? chunks[i + 1].start : len;
+
+   for (i = 0; i < n; i++)
+      started[i] = !pthread_create(threads + i, NULL, parse_chunk, chunks + i);
+
+   for (i = 0; i < n; i++)
+   {
+      if (started[i])
+         pthread_join(threads[i], NULL);
+      else
+         parse_chunk(chunks + i);
+   }
+
+   in = string_input(src, len);
+   *pos = 0;
+   i = 0;
+
+   while (i < n)
+   {
+      if (chunks[i].start == *pos)
+      {
+         for (j = 0; j < chunks[i].num_stmts; j++)
+            stmt_append(&stmts, num, &alloc, chunks[i].stmts[j]);
+
+         *pos = chunks[i].ok ? chunks[i].end : chunks[i].stop;
+
+         if (chunks[i].ok)
+         {
+            i++;
+            continue;
+         }
+      }
+
+      /* *pos is a real boundary, so parse on from it serially */
+      in->start = *pos;
+
+      while (1)
+      {
+         skip_whitespace(in);
+         *pos = in->start;
+
+         if (!(a = parse(in, stmt)))
+         {
+            syntax_err(in, err);
+            return stmts;
+         }
+
+         stmt_append(&stmts, num, &alloc, a);
+
+         while (i < n && chunks[i].start < in->start)
+            i++;
+
+         if (i < n && chunks[i].start == in->start)
+         {
+            *pos = in->start;
+            break;
+         }
+      }
+   }
+
+   return stmts;
+}
+
+/*
+   Parse and resolve every statement of a file, stopping at the first
+   error. Nothing is evaluated, so files cannot affect one another and
+   references to globals are left to be checked when the file is run.
+*/
+void batch_file(batch_file_t * f, combinator_t * stmt, int chunks)
+{
+   ast_t ** stmts;
+   input_t * in;
+   handler_t h;
+   ast_t * a;
+   int len, n, i;
+
+   f->pos = 0;
+
+   if (!TRY(h))
+   {
+      f->err = h.err;
+      f->errors++;
+      return;
+   }
+
+   f->src = read_file(f->path, &len);
+
+   if (chunks > 1 && len >= SPLIT_MIN)
+   {
+      stmts = parse_split(stmt, f->src, len, chunks, &n, &f->pos, &f->err);
+
+      for (i = 0; i < n; i++)
+         resolve_stmt(stmts[i]);
+
+      if (f->pos < len)
+         f->errors++;
+   } else
+   {
+      in = string_input(f->src, len);
+
+      while (1)
+      {
+         skip_whitespace(in);
+         f->pos = in->start;
+
+         if (!(a = parse(in, stmt)))
+            break;
+
+         resolve_stmt(a);
+      }
+
+      if (in->start < in->length)
+      {
+         syntax_err(in, &f->err);
+         f->errors++;
+      }
+   }
+
+   handler_pop(&h);
+}
+
+void * batch_worker(void * arg)
+{
+   batch_t * b = (batch_t *) arg;
+   int i;
+
+   defer_unknown = 1;
+
+   while ((i = __sync_fetch_and_add(&b->next, 1)) < b->num_files)
+      batch_file(b->files + i, b->stmt, b->chunks);
+
+   return NULL;
+}
+
+/*
+   Process the given files on a pool of worker threads, which take files
+   in order from a shared counter. Diagnostics are printed once all are
+   done, in the order the files were given. Returns the number of files
+   with errors.
+*/
+int batch_run(combinator_t * stmt, char ** paths, int n, int jobs)
+{
+   pthread_t * threads;
+   batch_file_t * f;
+   batch_t b;
+   int i, off, failed = 0;
+
+   b.stmt = stmt;
+   b.files = (batch_file_t *) GC_MALLOC(n*sizeof(batch_file_t));
+   b.num_files = n;
+   b.next = 0;
+   b.chunks = jobs/n;
+
+   for (i = 0; i < n; i++)
+      b.files[i].path = paths[i];
+
+   if (jobs > n)
+      jobs = n;
+
+   threads = (pthread_t *) GC_MALLOC(jobs*sizeof(pthread_t));
+
+   for (i = 0; i < jobs; i++)
+      if (pthread_create(threads + i, NULL, batch_worker, &b))
+         break;
+
+   jobs = i;
+   if (jobs == 0)
+      batch_worker(&b);
+
+   for (i = 0; i < jobs; i++)
+      pthread_join(threads[i], NULL);
+
+   for (i = 0; i < n; i++)
+   {
+      f = b.files + i;
+
+      if (f->errors)
+      {
+         off = f->err.offset >= 0 ? f->err.offset : f->pos;
+         fprintf(stderr, "%s:%d: ", f->path, f->src ? line_of(f->src, off) : 0);
+         print_error(stderr, &f->err);
+         failed++;
+      }
+   }
+
+   return failed;
+}
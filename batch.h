@@ -0,0 +1,77 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#define GC_THREADS /* so threads are registered with the collector */
+#include <pthread.h>
+#include <unistd.h>
+#include "parser.h"
+#include "backend.h"
+#include "module.h"
+#include "gc.h"
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#define SPLIT_MIN 65536 /* smallest file whose parsing is split up */
+
+typedef struct batch_file_t
+{
+   char * path;
+   char * src;
+   err_t err; /* first error, if any */
+   int pos; /* offset of the statement being processed */
+   int errors;
+} batch_file_t;
+
+typedef struct batch_t
+{
+   combinator_t * stmt;
+   batch_file_t * files;
+   int num_files;
+   int next; /* index of next file to be taken by a worker */
+   int chunks; /* threads each file may be parsed on */
+} batch_t;
+
+typedef struct chunk_t
+{
+   combinator_t * stmt;
+   char * src;
+   int start; /* chunk is src[start, end) */
+   int end;
+   ast_t ** stmts;
+   int num_stmts;
+   int stop; /* offset just after the last statement parsed */
+   int ok; /* statements were parsed exactly up to end */
+} chunk_t;
+
+int batch_jobs(void);
+
+ast_t ** parse_split(combinator_t * stmt, char * src, int len, int n,
+                                      int * num, int * pos, err_t * err);
+
+int batch_run(combinator_t * stmt, char ** paths, int n, int jobs);
+
+#endif
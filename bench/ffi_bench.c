@@ -0,0 +1,94 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <time.h>
+#include "ffi.h"
+
+#define ITERS 100000000L
+
+__attribute__ ((noinline)) double scale(double x, long n)
+{
+   return x*n;
+}
+
+double elapsed(struct timespec * t0)
+{
+   struct timespec t1;
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec)*1e-9;
+}
+
+void report(const char * name, double secs)
+{
+   printf("%-8s %8.3f s %8.2f ns/call\n", name, secs, secs*1e9/ITERS);
+}
+
+/*
+   Compares a call through the cached stub for scale's signature with
+   a plain C call through a function pointer, which is the least a
+   foreign call could cost.
+*/
+int main(void)
+{
+   double (* volatile fp)(double, long) = scale;
+   type_t * args[2];
+   struct timespec t0;
+   value_t fn, vals[2], r;
+   double acc = 0;
+   long i;
+
+   GC_INIT();
+   sym_tab_init();
+   types_init();
+
+   args[0] = t_double;
+   args[1] = t_int;
+
+   fn.type = ffi_sig(t_double, 2, args);
+   fn.v.p = scale;
+
+   vals[0].type = t_double;
+   vals[0].v.d = 0.5;
+   vals[1].type = t_int;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (i = 0; i < ITERS; i++)
+      acc += fp(0.5, i);
+   report("native", elapsed(&t0));
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (i = 0; i < ITERS; i++)
+   {
+      vals[1].v.i = i;
+      r = ffi_call(fn, vals);
+      acc += r.v.d;
+   }
+   report("ffi", elapsed(&t0));
+
+   return acc == 0;
+}
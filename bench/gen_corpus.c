@@ -0,0 +1,176 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+   The optimised grammar parses a parenthesised expression once at each
+   level, so deep nesting costs no more per byte than shallow nesting.
+*/
+#define PAREN_DEPTH 256
+
+const char * ops[] = { " + ", " - ", " * ", " / ", " % " };
+
+long written = 0;
+
+void emit(const char * s)
+{
+   written += strlen(s);
+   fputs(s, stdout);
+}
+
+void number(void)
+{
+   char buf[16];
+
+   sprintf(buf, "%d", rand() % 1000);
+   emit(buf);
+}
+
+/* a fresh identifier, so the symbol table keeps growing */
+void name(void)
+{
+   static const char * parts[] = { "alpha", "beta", "gamma", "delta",
+                                   "epsilon", "zeta", "eta", "theta" };
+   char buf[64];
+
+   sprintf(buf, "%s_%s%d", parts[rand() % 8], parts[rand() % 8],
+                           rand() % 1000000);
+   emit(buf);
+}
+
+/* e.g. (1 + (2 * (3 - ...))) nested to the given depth */
+void parens(int depth)
+{
+   int i;
+
+   for (i = 0; i < depth; i++)
+   {
+      emit("(");
+      number();
+      emit(ops[rand() % 5]);
+   }
+
+   number();
+
+   for (i = 0; i < depth; i++)
+      emit(")");
+}
+
+/* a chain of operators mixing every precedence level */
+void chain(int len)
+{
+   int i;
+
+   for (i = 0; i < len; i++)
+   {
+      if (rand() % 4 == 0)
+         name();
+      else
+         number();
+      emit(ops[rand() % 5]);
+   }
+
+   number();
+}
+
+/* an integer literal of up to 4096 digits */
+void literal(void)
+{
+   char buf[4097];
+   int i, len = 1 << (rand() % 13);
+
+   buf[0] = '1' + rand() % 9;
+   for (i = 1; i < len; i++)
+      buf[i] = '0' + rand() % 10;
+   buf[len] = '\0';
+
+   emit(buf);
+}
+
+/* assignments of calls, indexing and slot access */
+void idents(void)
+{
+   name();
+   emit(" = ");
+   name();
+   emit("(");
+   name();
+   emit(", ");
+   name();
+   emit(".");
+   name();
+   emit(", ");
+   name();
+   emit("[");
+   name();
+   emit("]) + ");
+   name();
+}
+
+/*
+   Write a synthetic source of one kind, of at least the given size, to
+   stdout. The output is the same on every run.
+*/
+int main(int argc, char ** argv)
+{
+   long bytes;
+   char * kind;
+
+   if (argc != 3)
+   {
+      fprintf(stderr, "usage: gen_corpus parens|ops|ints|idents bytes\n");
+      return 1;
+   }
+
+   kind = argv[1];
+   bytes = atol(argv[2]);
+
+   srand(1);
+
+   while (written < bytes)
+   {
+      if (strcmp(kind, "parens") == 0)
+         parens(1 + rand() % PAREN_DEPTH);
+      else if (strcmp(kind, "ops") == 0)
+         chain(1 + rand() % 1024);
+      else if (strcmp(kind, "ints") == 0)
+         literal();
+      else if (strcmp(kind, "idents") == 0)
+         idents();
+      else
+      {
+         fprintf(stderr, "Unknown corpus %s\n", kind);
+         return 1;
+      }
+
+      emit(";\n");
+   }
+
+   return 0;
+}
@@ -0,0 +1,162 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <time.h>
+#include "grammar.h"
+#include "incr.h"
+#include "module.h"
+
+double now(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t);
+
+   return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+/*
+   Serialise everything a parse produces, so that two parses can be
+   compared byte for byte.
+*/
+char * doc_image(doc_t * doc, size_t * len)
+{
+   FILE * f;
+   char * buf;
+   int i;
+
+   f = open_memstream(&buf, len);
+
+   for (i = 0; i < doc->num_stmts; i++)
+   {
+      fprintf(f, "%d %d ", doc->stmts[i]->start, doc->stmts[i]->end);
+      write_ast(f, doc->stmts[i]);
+   }
+
+   fprintf(f, "%d ", doc->stop);
+   if (doc->err)
+   {
+      fprintf(f, "%d ", doc->err->offset);
+      print_error(f, doc->err);
+   }
+   fclose(f);
+
+   return buf;
+}
+
+int cmp_double(const void * a, const void * b)
+{
+   double x = *(const double *) a, y = *(const double *) b;
+
+   return x < y ? -1 : x > y;
+}
+
+void report(const char * name, double * t, int n)
+{
+   qsort(t, n, sizeof(double), cmp_double);
+
+   printf("%-12s p50 %9.1f us  p99 %9.1f us  max %9.1f us\n", name,
+          t[n/2]*1e6, t[n*99/100]*1e6, t[n - 1]*1e6);
+}
+
+/*
+   Make random small edits to a source file and time reparsing it, both
+   incrementally and in full, checking that the results are identical.
+*/
+int main(int argc, char ** argv)
+{
+   static const char chars[] = " 1x+*;()";
+   double * incr, * full;
+   doc_t * base, * d1, * d2;
+   char * src, * i1, * i2;
+   char text[2];
+   combinator_t * stmt;
+   handler_t h;
+   size_t l1, l2;
+   int len, edits, e, off, del, ins, bad = 0;
+   double t;
+
+   if (argc != 2 && argc != 3)
+   {
+      fprintf(stderr, "usage: incr_bench file [edits]\n");
+      return 1;
+   }
+
+   edits = argc == 3 ? atoi(argv[2]) : 1000;
+   if (edits <= 0)
+      edits = 1000;
+
+   incr = (double *) malloc(edits*sizeof(double));
+   full = (double *) malloc(edits*sizeof(double));
+
+   ast_init();
+   sym_tab_init();
+   types_init();
+   stmt = grammar();
+
+   if (!TRY(h))
+   {
+      print_error(stderr, &h.err);
+      return 1;
+   }
+
+   src = read_file(argv[1], &len);
+   base = doc_parse(stmt, src, len);
+   srand(1);
+
+   printf("%d bytes, %d statements\n", len, base->num_stmts);
+
+   for (e = 0; e < edits; e++)
+   {
+      off = rand() % len;
+      del = rand() % 3 == 0 ? rand() % 3 : 0;
+      if (off + del > len)
+         del = len - off;
+      ins = del ? rand() % 2 : 1;
+      text[0] = chars[rand() % (sizeof(chars) - 1)];
+
+      t = now();
+      d1 = doc_edit(base, off, del, text, ins);
+      incr[e] = now() - t;
+
+      t = now();
+      d2 = doc_parse(stmt, d1->src, d1->len);
+      full[e] = now() - t;
+
+      i1 = doc_image(d1, &l1);
+      i2 = doc_image(d2, &l2);
+      if (l1 != l2 || memcmp(i1, i2, l1))
+         bad++;
+      free(i1);
+      free(i2);
+   }
+
+   report("incremental", incr, edits);
+   report("full", full, edits);
+   printf("%d of %d edits differ from a full parse\n", bad, edits);
+
+   return bad != 0;
+}
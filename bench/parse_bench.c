@@ -0,0 +1,143 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <time.h>
+#include <sys/resource.h>
+#include "grammar.h"
+#include "module.h"
+
+double now(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t);
+
+   return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+void parse_all(combinator_t * stmt, char * src, int len, int rec)
+{
+   input_t * in = string_input(src, len);
+   err_t err;
+
+   if (rec)
+      while (recognise(in, stmt)) ;
+   else
+      while (parse(in, stmt)) ;
+
+   skip_whitespace(in);
+
+   if (in->start < len)
+      throw_err(syntax_err(in, &err));
+}
+
+/*
+   Parse repeatedly for at least a second, returning the best time.
+*/
+double best_time(combinator_t * stmt, char * src, int len, int rec)
+{
+   double t, best = 0, total = 0;
+   int passes = 0;
+
+   while (passes < 3 || total < 1.0)
+   {
+      t = now();
+      parse_all(stmt, src, len, rec);
+      t = now() - t;
+
+      if (passes == 0 || t < best)
+         best = t;
+      total += t;
+      passes++;
+   }
+
+   return best;
+}
+
+/*
+   Parse a file with the cesium grammar and print one line of JSON
+   giving the best throughput, the allocations and bytes allocated per
+   byte parsed, the throughput when only recognising the input, and the
+   peak resident set size.
+*/
+int main(int argc, char ** argv)
+{
+   combinator_t * stmt;
+   struct rusage ru;
+   handler_t h;
+   size_t before, alloc;
+   long count, rec_count;
+   double best, rec_best;
+   char * src, * name;
+   int len;
+
+   if (argc != 2)
+   {
+      fprintf(stderr, "usage: parse_bench file\n");
+      return 1;
+   }
+
+   GC_INIT();
+   ast_init();
+   sym_tab_init();
+   types_init();
+   stmt = grammar();
+
+   if (!TRY(h))
+   {
+      print_error(stderr, &h.err);
+      return 1;
+   }
+
+   src = read_file(argv[1], &len);
+
+   before = GC_get_total_bytes();
+   count = alloc_count();
+   parse_all(stmt, src, len, 0);
+   alloc = GC_get_total_bytes() - before;
+   count = alloc_count() - count;
+
+   rec_count = alloc_count();
+   parse_all(stmt, src, len, 1);
+   rec_count = alloc_count() - rec_count;
+
+   best = best_time(stmt, src, len, 0);
+   rec_best = best_time(stmt, src, len, 1);
+
+   getrusage(RUSAGE_SELF, &ru);
+
+   name = strrchr(argv[1], '/');
+   name = name ? name + 1 : argv[1];
+
+   printf("{\"corpus\": \"%s\", \"bytes\": %d, "
+          "\"mb_per_s\": %.2f, \"allocs_per_byte\": %.3f, "
+          "\"alloc_bytes_per_byte\": %.2f, \"recognise_mb_per_s\": %.2f, "
+          "\"recognise_allocs_per_byte\": %.3f, \"peak_rss_kb\": %ld}\n",
+          name, len, len/best/1e6, (double) count/len, (double) alloc/len,
+          len/rec_best/1e6, (double) rec_count/len, ru.ru_maxrss);
+
+   return 0;
+}
@@ -0,0 +1,157 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include "grammar.h"
+#include "repl.h"
+#include "array.h"
+#include "ffi.h"
+#include "module.h"
+
+typedef struct
+{
+   double t[PHASES + 1]; /* time in each phase, then in total */
+} sample_t;
+
+int key;
+
+int cmp_sample(const void * a, const void * b)
+{
+   double x = ((const sample_t *) a)->t[key];
+   double y = ((const sample_t *) b)->t[key];
+
+   return x < y ? -1 : x > y;
+}
+
+void report(const char * name, sample_t * s, int n)
+{
+   double sum = 0;
+   int i;
+
+   qsort(s, n, sizeof(sample_t), cmp_sample);
+
+   for (i = 0; i < n; i++)
+      sum += s[i].t[key];
+
+   printf("%-8s %10.1f %10.1f %10.1f %10.1f\n", name, s[n/2].t[key]*1e6,
+          s[n*99/100].t[key]*1e6, s[n - 1].t[key]*1e6, sum*1e3);
+}
+
+/*
+   Replay a transcript of REPL input through repl_step, as the REPL
+   would run it, the given number of times. Output of the statements
+   is discarded. Prints percentiles of the latency of each statement,
+   overall and for each phase.
+*/
+int main(int argc, char ** argv)
+{
+   combinator_t * stmt;
+   sample_t * s = NULL;
+   input_t * in;
+   int alloc = 0, n = 0, runs, run, out, err, null, i;
+   double total;
+
+   if (argc != 2 && argc != 3)
+   {
+      fprintf(stderr, "usage: repl_bench transcript [runs]\n");
+      return 1;
+   }
+
+   runs = argc == 3 ? atoi(argv[2]) : 10;
+
+   ast_init();
+   sym_tab_init();
+   types_init();
+   spec_init();
+   dispatch_init();
+   array_init();
+   ffi_init();
+   parse_profile_init();
+
+   stmt = grammar();
+   module_init(stmt);
+
+   if (access(argv[1], R_OK))
+   {
+      fprintf(stderr, "Unable to open %s\n", argv[1]);
+      return 1;
+   }
+
+   fflush(stdout);
+   out = dup(1);
+   err = dup(2);
+   null = open("/dev/null", O_WRONLY);
+   dup2(null, 1);
+   dup2(null, 2);
+
+   for (run = 0; run < runs; run++)
+   {
+      in = new_input();
+      in->file = fopen(argv[1], "r");
+
+      do
+      {
+         if (n == alloc)
+         {
+            alloc = alloc*2 + 64;
+            s = (sample_t *) realloc(s, alloc*sizeof(sample_t));
+         }
+      } while (repl_step(in, stmt, s[n++].t));
+
+      n--; /* the end of input is not a statement */
+      fclose(in->file);
+   }
+
+   fflush(stdout);
+   fflush(stderr);
+   dup2(out, 1);
+   dup2(err, 2);
+
+   if (n == 0)
+   {
+      fprintf(stderr, "No statements in %s\n", argv[1]);
+      return 1;
+   }
+
+   for (i = 0; i < n; i++)
+   {
+      for (total = 0, key = 0; key < PHASES; key++)
+         total += s[i].t[key];
+      s[i].t[PHASES] = total;
+   }
+
+   printf("%d statements\n", n);
+   printf("%-8s %10s %10s %10s %10s\n", "phase", "p50 us", "p99 us",
+          "max us", "total ms");
+
+   for (key = 0; key < PHASES; key++)
+      report(phase_names[key], s, n);
+
+   report("total", s, n);
+
+   return 0;
+}
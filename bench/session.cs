@@ -0,0 +1,34 @@
+x = 1;
+y = 2.5;
+x + 2 * 3;
+y * y - 1.0;
+sq = lambda(a) a * a;
+sq(12);
+sq(x + 4);
+fact = lambda(n) if n then n * fact(n - 1) else 1;
+fact(10);
+fact(20);
+v = array(1000, 1.5);
+sum(v + v * v);
+w = iota(1000);
+sum(w * w);
+length(copy(w));
+type point(px: double, py: double);
+p = point(1.5, 2.5);
+p.px * p.py;
+type pair(fst, snd);
+pair(p, 3);
+extern sqrt(double) : double;
+sqrt(p.px * p.px + p.py * p.py);
+extern pow(double, double) : double;
+pow(2.0, 10.0);
+[1, 2, 3];
+w[999] + w[0];
+fib = lambda(n) if n then (if n - 1 then fib(n - 1) + fib(n - 2) else 1) else 0;
+fib(15);
+undefined_name + 1;
+1 +;
+x = x + 1;
+x;
+:profile
+sq(sq(sq(2)));
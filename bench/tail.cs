@@ -0,0 +1,5 @@
+count = lambda(n) if n then count(n - 1) else 0;
+count(100000000);
+even = lambda(n) if n then odd(n - 1) else 1;
+odd = lambda(n) if n then even(n - 1) else 0;
+even(100000000);
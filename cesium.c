@@ -26,72 +26,83 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdio.h>
 #include "parser.h"
+#include "grammar.h"
 #include "types.h"
+#include "env.h"
 #include "backend.h"
+#include "array.h"
+#include "ffi.h"
+#include "module.h"
+#include "server.h"
+#include "batch.h"
+#include "pipeline.h"
+#include "repl.h"
 
-extern jmp_buf exc;
+combinator_t * stmt;
 
-int main(void)
+void repl(void)
 {
-   ast_t * a;
    input_t * in = new_input();
-   int jval;
-
-   ast_init();
-   sym_tab_init();
-   types_init();
 
    printf("Welcome to Cesium v0.3\n\n");
    printf("> ");
+   fflush(stdout);
+
+   while (repl_step(in, stmt, NULL))
+   {
+      printf("> ");
+      fflush(stdout);
+   }
+
+   printf("\n");
+
+   if (ic_stats)
+      ic_dump(stderr);
+}
 
-   combinator_t * stmt = new_combinator();
-   combinator_t * exp = new_combinator();
-   combinator_t * paren = new_combinator();
-   combinator_t * base = new_combinator();
+/*
+   cesium --daemon [socket] keeps an initialised interpreter resident,
+   and runs a session for each connection from cesium_client.
 
-   seq(paren, T_LIST,
-          match("("),
-          exp,
-          match(")"),
-       NULL);
+   cesium --run file runs a script, with parsing, resolution and
+   execution pipelined on separate threads.
 
-   multi(base, T_NONE, 
-          capture(T_INT, integer()),
-          paren,
-       NULL);
+   cesium [-j jobs] file ... parses and resolves the given files in
+   parallel, reporting any errors.
+*/
+int main(int argc, char ** argv)
+{
+   int jobs = batch_jobs(), first = 1;
 
-   expr(exp, base);
+   alloc_init();
+   ast_init();
+   sym_tab_init();
+   types_init();
+   spec_init();
+   dispatch_init();
+   array_init();
+   ffi_init();
+   parse_profile_init();
 
-   expr_insert(exp, 0, T_ADD, EXPR_INFIX, ASSOC_LEFT, match("+"));
-   expr_altern(exp, 0, T_SUB, match("-"));
+   stmt = grammar();
+   module_init(stmt);
 
-   expr_insert(exp, 1, T_MUL, EXPR_INFIX, ASSOC_LEFT, match("*"));
-   expr_altern(exp, 1, T_DIV, match("/"));
-   expr_altern(exp, 1, T_REM, match("%"));
+   if (argc > 1 && strcmp(argv[1], "--daemon") == 0)
+      serve(argc > 2 ? argv[2] : server_socket(), repl);
 
-   seq(stmt, T_NONE,
-          exp,
-          match(";"),
-       NULL);
+   if (argc == 3 && strcmp(argv[1], "--run") == 0)
+      return pipeline_run(stmt, argv[2]) != 0;
 
-   while (1)
+   if (argc > 2 && strcmp(argv[1], "-j") == 0)
    {
-      if (!(jval = setjmp(exc)))
-      {
-         a = parse(in, stmt);
-         if (!a) break;
-      } else
-      {
-         while (read1(in) != '\n') ;
-      }
-      
-      printf("\n> ");
-      in->start = 0;
-      in->length = 0;
+      jobs = atoi(argv[2]);
+      first = 3;
    }
 
-   printf("\n");
+   if (argc > first)
+      return batch_run(stmt, argv + first, argc - first, jobs) != 0;
 
-   return 0;
+   repl();
 
+   return 0;
 }
@@ -0,0 +1,118 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <poll.h>
+#include "server.h"
+
+int write_all(int fd, const char * buf, ssize_t len)
+{
+   ssize_t n;
+
+   while (len > 0)
+   {
+      if ((n = write(fd, buf, len)) < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+
+      buf += n;
+      len -= n;
+   }
+
+   return 0;
+}
+
+/*
+   Thin client for a server started with cesium --daemon. It copies
+   stdin to the server until end of file, and everything the server
+   sends back to stdout, until the server closes the connection.
+*/
+int main(int argc, char ** argv)
+{
+   struct sockaddr_un addr;
+   struct pollfd fds[2];
+   char buf[4096];
+   char * path = argc > 1 ? argv[1] : server_socket();
+   ssize_t n;
+   int fd;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+   fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+   {
+      perror(path);
+      return 1;
+   }
+
+   fds[0].fd = 0;
+   fds[0].events = POLLIN;
+   fds[1].fd = fd;
+   fds[1].events = POLLIN;
+
+   while (1)
+   {
+      if (poll(fds, 2, -1) < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         perror("poll");
+         return 1;
+      }
+
+      if (fds[0].revents)
+      {
+         n = read(0, buf, sizeof(buf));
+
+         if (n > 0)
+            write_all(fd, buf, n);
+         else
+         {
+            /* no more input, but the server may still have output */
+            shutdown(fd, SHUT_WR);
+            fds[0].fd = -1;
+         }
+      }
+
+      if (fds[1].revents)
+      {
+         n = read(fd, buf, sizeof(buf));
+
+         if (n <= 0)
+            break;
+
+         write_all(1, buf, n);
+      }
+   }
+
+   close(fd);
+
+   return 0;
+}
@@ -0,0 +1,259 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "dispatch.h"
+
+method_t ** method_tab;
+
+ic_t * ic_sites; /* only kept if CESIUM_IC_STATS is set */
+
+int ic_stats;
+
+int method_hash(tag_t op, type_t * t1, type_t * t2)
+{
+   unsigned long h = (unsigned long) op;
+
+   h = h*31 + ((unsigned long) t1 >> 4);
+   h = h*31 + ((unsigned long) t2 >> 4);
+
+   return h % METHOD_TAB_SIZE;
+}
+
+void method_add(tag_t op, type_t * t1, type_t * t2, method_fn fn)
+{
+   int hash = method_hash(op, t1, t2);
+   method_t * m;
+
+   for (m = method_tab[hash]; m; m = m->next)
+   {
+      if (m->op == op && m->t1 == t1 && m->t2 == t2)
+      {
+         m->fn = fn;
+         return;
+      }
+   }
+
+   m = (method_t *) GC_MALLOC(sizeof(method_t));
+   m->op = op;
+   m->t1 = t1;
+   m->t2 = t2;
+   m->fn = fn;
+   m->next = method_tab[hash];
+   method_tab[hash] = m;
+}
+
+method_fn method_lookup(tag_t op, type_t * t1, type_t * t2)
+{
+   method_t * m;
+
+   for (m = method_tab[method_hash(op, t1, t2)]; m; m = m->next)
+      if (m->op == op && m->t1 == t1 && m->t2 == t2)
+         return m->fn;
+
+   return NULL;
+}
+
+value_t int_value(long i)
+{
+   value_t val;
+   val.type = t_int;
+   val.v.i = i;
+   return val;
+}
+
+value_t double_value(double d)
+{
+   value_t val;
+   val.type = t_double;
+   val.v.d = d;
+   return val;
+}
+
+double to_double(value_t a)
+{
+   return a.type == t_int ? (double) a.v.i : a.v.d;
+}
+
+value_t int_add(value_t a, value_t b)
+{
+   return int_value(a.v.i + b.v.i);
+}
+
+value_t int_sub(value_t a, value_t b)
+{
+   return int_value(a.v.i - b.v.i);
+}
+
+value_t int_mul(value_t a, value_t b)
+{
+   return int_value(a.v.i * b.v.i);
+}
+
+value_t int_div(value_t a, value_t b)
+{
+   if (b.v.i == 0)
+      exception("Division by zero\n");
+   if (b.v.i == -1 && a.v.i == LONG_MIN)
+      exception("Integer overflow in division\n");
+   return int_value(a.v.i / b.v.i);
+}
+
+value_t int_rem(value_t a, value_t b)
+{
+   if (b.v.i == 0)
+      exception("Division by zero\n");
+   /* the remainder is defined, but computing it traps */
+   if (b.v.i == -1)
+      return int_value(0);
+   return int_value(a.v.i % b.v.i);
+}
+
+value_t double_add(value_t a, value_t b)
+{
+   return double_value(to_double(a) + to_double(b));
+}
+
+value_t double_sub(value_t a, value_t b)
+{
+   return double_value(to_double(a) - to_double(b));
+}
+
+value_t double_mul(value_t a, value_t b)
+{
+   return double_value(to_double(a) * to_double(b));
+}
+
+value_t double_div(value_t a, value_t b)
+{
+   return double_value(to_double(a) / to_double(b));
+}
+
+void dispatch_init(void)
+{
+   type_t * num[2];
+   int i, j;
+
+   method_tab = (method_t **) GC_MALLOC(METHOD_TAB_SIZE*sizeof(method_t *));
+
+   ic_stats = getenv("CESIUM_IC_STATS") != NULL;
+
+   method_add(T_ADD, t_int, t_int, int_add);
+   method_add(T_SUB, t_int, t_int, int_sub);
+   method_add(T_MUL, t_int, t_int, int_mul);
+   method_add(T_DIV, t_int, t_int, int_div);
+   method_add(T_REM, t_int, t_int, int_rem);
+
+   /* any arithmetic involving a double is done in double precision */
+   num[0] = t_int;
+   num[1] = t_double;
+
+   for (i = 0; i < 2; i++)
+   {
+      for (j = 0; j < 2; j++)
+      {
+         if (num[i] == t_int && num[j] == t_int)
+            continue;
+
+         method_add(T_ADD, num[i], num[j], double_add);
+         method_add(T_SUB, num[i], num[j], double_sub);
+         method_add(T_MUL, num[i], num[j], double_mul);
+         method_add(T_DIV, num[i], num[j], double_div);
+      }
+   }
+}
+
+ic_t * new_ic(tag_t op)
+{
+   ic_t * ic = (ic_t *) GC_MALLOC(sizeof(ic_t));
+   ic->op = op;
+
+   /* otherwise a site would never be freed, only to be reported */
+   if (ic_stats)
+   {
+      ic->next = ic_sites;
+      ic_sites = ic;
+   }
+
+   return ic;
+}
+
+/*
+   Apply the operator at the given site to a and b. The method for each
+   pair of argument types seen at the site is cached there, so that a
+   site which only ever sees one or a few types never consults the
+   method table after warming up.
+*/
+value_t dispatch(ast_t * site, value_t a, value_t b)
+{
+   ic_t * ic = site->ic;
+   method_fn fn;
+   int i;
+
+   if (ic == NULL)
+      site->ic = ic = new_ic(site->typ);
+
+   for (i = 0; i < ic->num && i < IC_POLY; i++)
+   {
+      if (ic->t1[i] == a.type && ic->t2[i] == b.type)
+      {
+         ic->hits++;
+         return ic->fn[i](a, b);
+      }
+   }
+
+   ic->misses++;
+
+   if (!(fn = method_lookup(site->typ, a.type, b.type)))
+      exception("No method for operator and argument types\n");
+
+   if (ic->num < IC_POLY)
+   {
+      ic->t1[ic->num] = a.type;
+      ic->t2[ic->num] = b.type;
+      ic->fn[ic->num] = fn;
+   }
+
+   if (ic->num <= IC_POLY)
+      ic->num++;
+
+   return fn(a, b);
+}
+
+void ic_dump(FILE * out)
+{
+   static const char * ops[] = { "+", "-", "*", "/", "%" };
+   ic_t * ic;
+
+   fprintf(out, "op  state         hits      misses\n");
+
+   for (ic = ic_sites; ic; ic = ic->next)
+   {
+      fprintf(out, "%-3s %-5s %12ld %11ld\n",
+              ic->op >= T_ADD && ic->op <= T_REM ? ops[ic->op - T_ADD] : "?",
+              ic->num <= 1 ? "mono" : ic->num <= IC_POLY ? "poly" : "mega",
+              ic->hits, ic->misses);
+   }
+}
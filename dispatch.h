@@ -0,0 +1,76 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdio.h>
+#include <limits.h>
+#include "ast.h"
+#include "types.h"
+#include "exception.h"
+#include "gc.h"
+
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#define METHOD_TAB_SIZE 1024
+
+#define IC_POLY 4 /* distinct type pairs cached before a site goes megamorphic */
+
+typedef value_t (*method_fn)(value_t, value_t);
+
+typedef struct method_t
+{
+   tag_t op;
+   type_t * t1;
+   type_t * t2;
+   method_fn fn;
+   struct method_t * next;
+} method_t;
+
+typedef struct ic_t
+{
+   tag_t op;
+   int num; /* number of cached entries, IC_POLY + 1 once megamorphic */
+   type_t * t1[IC_POLY];
+   type_t * t2[IC_POLY];
+   method_fn fn[IC_POLY];
+   long hits;
+   long misses;
+   struct ic_t * next; /* all sites, if they are to be reported */
+} ic_t;
+
+extern int ic_stats;
+
+void dispatch_init(void);
+
+void method_add(tag_t op, type_t * t1, type_t * t2, method_fn fn);
+
+method_fn method_lookup(tag_t op, type_t * t1, type_t * t2);
+
+value_t dispatch(ast_t * site, value_t a, value_t b);
+
+void ic_dump(FILE * out);
+
+#endif
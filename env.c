@@ -0,0 +1,278 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "env.h"
+
+scope_t * new_scope(scope_t * parent)
+{
+   scope_t * scope = (scope_t *) GC_MALLOC(sizeof(scope_t));
+   scope->binds = NULL;
+   scope->num_slots = 0;
+   scope->captured = NULL;
+   scope->num_captured = 0;
+   scope->parent = parent;
+   return scope;
+}
+
+bind_t * bind_find(bind_t * b, sym_t * sym)
+{
+   while (b && b->sym != sym)
+      b = b->next;
+
+   return b;
+}
+
+int scope_bind(scope_t * scope, sym_t * sym)
+{
+   bind_t * b = (bind_t *) GC_MALLOC(sizeof(bind_t));
+   b->sym = sym;
+   b->slot = scope->num_slots++;
+   b->next = scope->binds;
+   scope->binds = b;
+   return b->slot;
+}
+
+void global_define(sym_t * sym, value_t val)
+{
+   sym->val = val;
+   sym->version++;
+}
+
+void unknown_ident(sym_t * sym)
+{
+   char * msg = GC_MALLOC(strlen(sym->name) + 30);
+   sprintf(msg, "Unknown identifier %s\n", sym->name);
+   throw_error(ERR_NAME, -1, msg);
+}
+
+/*
+   Find a variable in the given scope. If it is a local of an enclosing
+   lambda it becomes a free variable of every lambda in between, each of
+   which copies it into its closure when the closure is made.
+*/
+void resolve_var(scope_t * scope, ast_t * ast)
+{
+   bind_t * b;
+
+   if (scope == NULL)
+      ast->loc = LOC_GLOBAL;
+   else if (b = bind_find(scope->binds, ast->sym))
+   {
+      ast->loc = LOC_LOCAL;
+      ast->slot = b->slot;
+   } else if (b = bind_find(scope->captured, ast->sym))
+   {
+      ast->loc = LOC_CAPTURED;
+      ast->slot = b->slot;
+   } else
+   {
+      resolve_var(scope->parent, ast);
+      if (ast->loc == LOC_GLOBAL)
+         return;
+
+      b = (bind_t *) GC_MALLOC(sizeof(bind_t));
+      b->sym = ast->sym;
+      b->slot = scope->num_captured++;
+      b->next = scope->captured;
+      scope->captured = b;
+
+      ast->loc = LOC_CAPTURED;
+      ast->slot = b->slot;
+   }
+}
+
+__thread int defer_unknown;
+
+void resolve_ident(scope_t * scope, ast_t * ast)
+{
+   /* globals may be defined later than a lambda which refers to them */
+   if (scope == NULL && ast->sym->version == 0 && !defer_unknown)
+      unknown_ident(ast->sym);
+
+   resolve_var(scope, ast);
+}
+
+/*
+   Mark the calls whose value is the value of the given expression. Only
+   the last call in a chain such as f(x)(y) is in tail position.
+*/
+void mark_tail(ast_t * ast)
+{
+   ast_t * a;
+
+   switch (ast->typ)
+   {
+   case T_LIST:
+      mark_tail(ast->child);
+      break;
+   case T_IF:
+      mark_tail(ast->child->next);
+      mark_tail(ast->child->next->next);
+      break;
+   case T_CALL:
+      for (a = ast->child; a->next; a = a->next) ;
+      if (a->typ == T_ARGS)
+         ast->tail = 1;
+      break;
+   }
+}
+
+/*
+   Give a resolved lambda its type and, if it captures nothing, the
+   closure which every evaluation of it returns.
+*/
+void lambda_value(ast_t * ast)
+{
+   ast_t * p;
+   type_t ** args;
+   closure_t * cl;
+   int arity = 0, i;
+
+   for (p = ast->child->child; p; p = p->next)
+      arity++;
+
+   args = (type_t **) GC_MALLOC(arity*sizeof(type_t *));
+   for (i = 0; i < arity; i++)
+      args[i] = new_typevar();
+
+   ast->val.type = fn_to_lambda_type(fn_type(new_typevar(), arity, args));
+
+   if (ast->child->next->next == NULL)
+   {
+      cl = (closure_t *) GC_MALLOC(sizeof(closure_t));
+      cl->lambda = ast;
+      ast->val.v.p = cl;
+   }
+}
+
+void resolve_lambda(scope_t * scope, ast_t * ast)
+{
+   ast_t * params = ast->child;
+   ast_t * p, * caps, ** src;
+   bind_t * b;
+   int i;
+
+   scope = new_scope(scope);
+
+   for (p = params->child; p; p = p->next)
+   {
+      if (bind_find(scope->binds, p->sym))
+         exception("Duplicate parameter in lambda\n");
+
+      p->loc = LOC_LOCAL;
+      p->slot = scope_bind(scope, p->sym);
+   }
+
+   resolve(scope, params->next);
+   mark_tail(params->next);
+
+   ast->slot = scope->num_slots;
+
+   /* 
+      Record where each free variable lives in the enclosing scope, in
+      order of closure slot. Locals are never reassigned once captured,
+      so copying their values into a flat closure is safe.
+   */
+   if (scope->num_captured)
+   {
+      src = (ast_t **) GC_MALLOC(scope->num_captured*sizeof(ast_t *));
+
+      for (b = scope->captured; b; b = b->next)
+      {
+         src[b->slot] = new_ast();
+         src[b->slot]->typ = T_IDENT;
+         src[b->slot]->sym = b->sym;
+         resolve_var(scope->parent, src[b->slot]);
+      }
+
+      for (i = scope->num_captured - 1; i > 0; i--)
+         src[i - 1]->next = src[i];
+
+      caps = ast1(T_CAPTURES, src[0]);
+      caps->slot = scope->num_captured;
+      params->next->next = caps;
+   }
+
+   lambda_value(ast);
+}
+
+void resolve(scope_t * scope, ast_t * ast)
+{
+   ast_t * a;
+
+   switch (ast->typ)
+   {
+   case T_INT:
+      ast->val.type = t_int;
+      ast->val.v.i = atol(ast->sym->name);
+      break;
+   case T_DOUBLE:
+      ast->val.type = t_double;
+      ast->val.v.d = atof(ast->sym->name);
+      break;
+   case T_IDENT:
+      resolve_ident(scope, ast);
+      break;
+   case T_ASSIGN:
+      a = ast->child;
+      if (scope == NULL)
+         a->loc = LOC_GLOBAL;
+      else
+      {
+         if (!bind_find(scope->binds, a->sym))
+            scope_bind(scope, a->sym);
+         resolve_var(scope, a);
+      }
+      resolve(scope, a->next);
+      break;
+   case T_LAMBDA:
+      resolve_lambda(scope, ast);
+      break;
+   case T_DATATYPE:
+      if (scope != NULL)
+         exception("Datatypes must be defined at the top level\n");
+      break;
+   case T_EXTERN:
+      if (scope != NULL)
+         exception("Foreign functions must be declared at the top level\n");
+      break;
+   case T_IMPORT:
+      if (scope != NULL)
+         exception("Modules must be imported at the top level\n");
+      break;
+   case T_SLOT:
+      /* slot names are looked up in the datatype at runtime */
+      break;
+   default:
+      for (a = ast->child; a; a = a->next)
+         resolve(scope, a);
+   }
+}
+
+void resolve_stmt(ast_t * ast)
+{
+   resolve(NULL, ast);
+}
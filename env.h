@@ -0,0 +1,80 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdlib.h>
+#include "ast.h"
+#include "types.h"
+#include "exception.h"
+#include "gc.h"
+
+#ifndef ENV_H
+#define ENV_H
+
+typedef struct bind_t
+{
+   sym_t * sym;
+   int slot;
+   struct bind_t * next;
+} bind_t;
+
+typedef struct scope_t
+{
+   bind_t * binds; /* locals, most recent first */
+   int num_slots; /* number of slots in frames for this scope */
+   bind_t * captured; /* free variables, most recent first */
+   int num_captured;
+   struct scope_t * parent;
+} scope_t;
+
+typedef struct closure_t
+{
+   ast_t * lambda; /* code */
+   value_t env[]; /* captured values */
+} closure_t;
+
+typedef struct frame_t
+{
+   value_t * slots; /* locals of running function */
+   value_t * env; /* captured values of running closure */
+} frame_t;
+
+extern __thread int defer_unknown; /* leave unknown globals until run */
+
+scope_t * new_scope(scope_t * parent);
+
+int scope_bind(scope_t * scope, sym_t * sym);
+
+void global_define(sym_t * sym, value_t val);
+
+void unknown_ident(sym_t * sym);
+
+void lambda_value(ast_t * ast);
+
+void resolve(scope_t * scope, ast_t * ast);
+
+void resolve_stmt(ast_t * ast);
+
+#endif
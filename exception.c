@@ -26,11 +26,68 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "exception.h"
 
-jmp_buf exc;
+__thread handler_t * handlers;
+
+jmp_buf * handler_push(handler_t * h)
+{
+   h->prev = handlers;
+   handlers = h;
+
+   return &h->buf;
+}
+
+void handler_pop(handler_t * h)
+{
+   handlers = h->prev;
+}
+
+/*
+   An error with no handler is a bug in the caller, so is fatal.
+*/
+void throw_err(const err_t * err)
+{
+   handler_t * h = handlers;
+
+   if (h == NULL)
+   {
+      print_error(stderr, err);
+      abort();
+   }
+
+   handlers = h->prev;
+   if (&h->err != err)
+      h->err = *err;
+
+   longjmp(h->buf, 1);
+}
+
+void throw_error(err_code code, int offset, const char * msg)
+{
+   err_t err;
+
+   err.code = code;
+   err.offset = offset;
+   err.msg = msg;
+   err.num_expected = 0;
+
+   throw_err(&err);
+}
 
 void exception(char * err)
 {
-   fprintf(stderr, err);
-   
-   longjmp(exc, 1);
-}
\ No newline at end of file
+   throw_error(ERR_RUNTIME, -1, err);
+}
+
+void print_error(FILE * out, const err_t * err)
+{
+   int i;
+
+   fputs(err->msg, out);
+
+   for (i = 0; i < err->num_expected; i++)
+      fprintf(out, "%s%s", i == 0 ? "Expected " : i == err->num_expected - 1 ?
+              " or " : ", ", err->expected[i]);
+
+   if (err->num_expected)
+      fprintf(out, "\n");
+}
@@ -25,11 +25,66 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <setjmp.h>
 
 #ifndef EXCEPTION_H
 #define EXCEPTION_H
 
+#define EXPECTED_MAX 16 /* alternatives recorded for a syntax error */
+
+typedef enum
+{
+   ERR_RUNTIME, ERR_SYNTAX, ERR_NAME, ERR_IO
+} err_code;
+
+typedef struct err_t
+{
+   err_code code;
+   int offset; /* in the input being parsed, -1 if not parsing */
+   const char * msg;
+   const char * expected[EXPECTED_MAX]; /* tokens which would have parsed */
+   int num_expected;
+} err_t;
+
+typedef struct handler_t
+{
+   jmp_buf buf;
+   err_t err; /* the error caught */
+   struct handler_t * prev;
+} handler_t;
+
+extern __thread handler_t * handlers; /* each thread's, innermost first */
+
+/*
+   Errors unwind to the innermost handler on the raising thread:
+
+      handler_t h;
+
+      if (TRY(h))
+      {
+         ...
+         handler_pop(&h);
+      } else
+         ... h.err ...
+
+   The handler is popped before control returns to it, so an error
+   in the else branch goes to the enclosing handler. Code leaving the
+   first branch early must pop the handler itself.
+*/
+#define TRY(h) (setjmp(*handler_push(&(h))) == 0)
+
+jmp_buf * handler_push(handler_t * h);
+
+void handler_pop(handler_t * h);
+
+void throw_err(const err_t * err);
+
+void throw_error(err_code code, int offset, const char * msg);
+
 void exception(char * err);
 
+void print_error(FILE * out, const err_t * err);
+
 #endif
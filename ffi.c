@@ -0,0 +1,263 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "ffi.h"
+
+/*
+   There is one precompiled stub for each shape of signature, that is
+   for each sequence of argument classes (long or double) and return
+   class (long, double or void). Each stub casts the foreign pointer to
+   the exact C function type and calls it directly, so the C compiler
+   does the register assignment for the platform's calling convention.
+*/
+#define L(n) args[n].v.i
+#define D(n) args[n].v.d
+
+#define STUBS(name, params, vals)                  \
+value_t name ## _l(void * fn, value_t * args)      \
+{                                                  \
+   value_t r;                                      \
+   r.type = t_int;                                 \
+   r.v.i = ((long (*) params) fn) vals;            \
+   return r;                                       \
+}                                                  \
+value_t name ## _d(void * fn, value_t * args)      \
+{                                                  \
+   value_t r;                                      \
+   r.type = t_double;                              \
+   r.v.d = ((double (*) params) fn) vals;          \
+   return r;                                       \
+}                                                  \
+value_t name ## _v(void * fn, value_t * args)      \
+{                                                  \
+   value_t r;                                      \
+   ((void (*) params) fn) vals;                    \
+   r.type = t_nil;                                 \
+   r.v.p = NULL;                                   \
+   return r;                                       \
+}
+
+STUBS(stub, (void), ())
+
+STUBS(stub_l, (long), (L(0)))
+STUBS(stub_d, (double), (D(0)))
+
+STUBS(stub_ll, (long, long), (L(0), L(1)))
+STUBS(stub_dl, (double, long), (D(0), L(1)))
+STUBS(stub_ld, (long, double), (L(0), D(1)))
+STUBS(stub_dd, (double, double), (D(0), D(1)))
+
+STUBS(stub_lll, (long, long, long), (L(0), L(1), L(2)))
+STUBS(stub_dll, (double, long, long), (D(0), L(1), L(2)))
+STUBS(stub_ldl, (long, double, long), (L(0), D(1), L(2)))
+STUBS(stub_ddl, (double, double, long), (D(0), D(1), L(2)))
+STUBS(stub_lld, (long, long, double), (L(0), L(1), D(2)))
+STUBS(stub_dld, (double, long, double), (D(0), L(1), D(2)))
+STUBS(stub_ldd, (long, double, double), (L(0), D(1), D(2)))
+STUBS(stub_ddd, (double, double, double), (D(0), D(1), D(2)))
+
+STUBS(stub_llll, (long, long, long, long), (L(0), L(1), L(2), L(3)))
+STUBS(stub_dlll, (double, long, long, long), (D(0), L(1), L(2), L(3)))
+STUBS(stub_ldll, (long, double, long, long), (L(0), D(1), L(2), L(3)))
+STUBS(stub_ddll, (double, double, long, long), (D(0), D(1), L(2), L(3)))
+STUBS(stub_lldl, (long, long, double, long), (L(0), L(1), D(2), L(3)))
+STUBS(stub_dldl, (double, long, double, long), (D(0), L(1), D(2), L(3)))
+STUBS(stub_lddl, (long, double, double, long), (L(0), D(1), D(2), L(3)))
+STUBS(stub_dddl, (double, double, double, long), (D(0), D(1), D(2), L(3)))
+STUBS(stub_llld, (long, long, long, double), (L(0), L(1), L(2), D(3)))
+STUBS(stub_dlld, (double, long, long, double), (D(0), L(1), L(2), D(3)))
+STUBS(stub_ldld, (long, double, long, double), (L(0), D(1), L(2), D(3)))
+STUBS(stub_ddld, (double, double, long, double), (D(0), D(1), L(2), D(3)))
+STUBS(stub_lldd, (long, long, double, double), (L(0), L(1), D(2), D(3)))
+STUBS(stub_dldd, (double, long, double, double), (D(0), L(1), D(2), D(3)))
+STUBS(stub_lddd, (long, double, double, double), (L(0), D(1), D(2), D(3)))
+STUBS(stub_dddd, (double, double, double, double), (D(0), D(1), D(2), D(3)))
+
+#define STUB_ROW(name) { name ## _l, name ## _d, name ## _v }
+
+/*
+   Indexed by shape: the stubs of arity n start at 2^n - 1, and bit i
+   of the offset from there is set if argument i is a double.
+*/
+static ffi_stub ffi_stubs[][3] =
+{
+   STUB_ROW(stub),
+   STUB_ROW(stub_l), STUB_ROW(stub_d),
+   STUB_ROW(stub_ll), STUB_ROW(stub_dl), STUB_ROW(stub_ld), STUB_ROW(stub_dd),
+   STUB_ROW(stub_lll), STUB_ROW(stub_dll), STUB_ROW(stub_ldl), STUB_ROW(stub_ddl),
+   STUB_ROW(stub_lld), STUB_ROW(stub_dld), STUB_ROW(stub_ldd), STUB_ROW(stub_ddd),
+   STUB_ROW(stub_llll), STUB_ROW(stub_dlll), STUB_ROW(stub_ldll), STUB_ROW(stub_ddll),
+   STUB_ROW(stub_lldl), STUB_ROW(stub_dldl), STUB_ROW(stub_lddl), STUB_ROW(stub_dddl),
+   STUB_ROW(stub_llld), STUB_ROW(stub_dlld), STUB_ROW(stub_ldld), STUB_ROW(stub_ddld),
+   STUB_ROW(stub_lldd), STUB_ROW(stub_dldd), STUB_ROW(stub_lddd), STUB_ROW(stub_dddd)
+};
+
+static ffi_sig_t * ffi_tab[FFI_TAB_SIZE];
+
+static void * ffi_self; /* handle for symbols of the running program */
+
+/*
+   Libraries named in CESIUM_FFI_LIBS, separated by colons, are loaded
+   into the global namespace, so their symbols can be found through the
+   handle for the program itself.
+*/
+void ffi_init(void)
+{
+   char * env = getenv("CESIUM_FFI_LIBS");
+   char * libs, * lib;
+
+   libs = env ? env : FFI_LIBS;
+   libs = strcpy((char *) GC_MALLOC_ATOMIC(strlen(libs) + 1), libs);
+
+   for (lib = strtok(libs, ":"); lib; lib = strtok(NULL, ":"))
+      if (dlopen(lib, RTLD_LAZY | RTLD_GLOBAL) == NULL)
+         fprintf(stderr, "Unable to load %s\n", lib);
+
+   ffi_self = dlopen(NULL, RTLD_LAZY);
+}
+
+unsigned long ffi_hash(type_t * ret, int arity, type_t ** args)
+{
+   unsigned long h = (unsigned long) ret;
+   int i;
+
+   for (i = 0; i < arity; i++)
+      h = h*31 + (unsigned long) args[i];
+
+   return (h >> 4) % FFI_TAB_SIZE;
+}
+
+ffi_stub ffi_select(type_t * ret, int arity, type_t ** args)
+{
+   int shape = 0, i;
+
+   if (arity > FFI_MAX_ARGS)
+      exception("Too many arguments for foreign function\n");
+
+   for (i = 0; i < arity; i++)
+   {
+      if (args[i] == t_double)
+         shape |= (1 << i);
+      else if (args[i] != t_int)
+         exception("Foreign function arguments must be int or double\n");
+   }
+
+   if (ret == t_int)
+      return ffi_stubs[(1 << arity) - 1 + shape][0];
+   else if (ret == t_double)
+      return ffi_stubs[(1 << arity) - 1 + shape][1];
+   else if (ret == t_nil)
+      return ffi_stubs[(1 << arity) - 1 + shape][2];
+
+   exception("Foreign function must return int, double or nothing\n");
+   return NULL;
+}
+
+/*
+   Signatures are interned, so each distinct one gets a single fn_type
+   which carries its stub. A foreign call then costs an indirect call
+   through the stub and a direct call to the C function.
+*/
+type_t * ffi_sig(type_t * ret, int arity, type_t ** args)
+{
+   unsigned long h = ffi_hash(ret, arity, args);
+   ffi_sig_t * s;
+   int i;
+
+   for (s = ffi_tab[h]; s; s = s->next)
+   {
+      if (s->type->ret != ret || s->type->arity != arity)
+         continue;
+
+      for (i = 0; i < arity; i++)
+         if (s->type->args[i] != args[i])
+            break;
+
+      if (i == arity)
+         return s->type;
+   }
+
+   s = (ffi_sig_t *) GC_MALLOC(sizeof(ffi_sig_t));
+   s->type = fn_type(ret, arity, args);
+   s->type->stub = ffi_select(ret, arity, args);
+   s->next = ffi_tab[h];
+   ffi_tab[h] = s;
+
+   return s->type;
+}
+
+value_t ffi_call(value_t fn, value_t * args)
+{
+   type_t * type = fn.type;
+   int i;
+
+   for (i = 0; i < type->arity; i++)
+      if (args[i].type != type->args[i])
+         exception("Argument of wrong type in foreign function call\n");
+
+   return type->stub(fn.v.p, args);
+}
+
+type_t * ffi_type(sym_t * name)
+{
+   if (name == sym_lookup("int"))
+      return t_int;
+   else if (name == sym_lookup("double"))
+      return t_double;
+
+   exception("Unknown type in extern declaration\n");
+   return NULL;
+}
+
+value_t define_extern(ast_t * ast)
+{
+   sym_t * name = ast->child->sym;
+   type_t * args[FFI_MAX_ARGS];
+   type_t * ret = t_nil;
+   value_t fn;
+   ast_t * a;
+   int n = 0;
+
+   for (a = ast->child->next->child; a; a = a->next)
+   {
+      if (n == FFI_MAX_ARGS)
+         exception("Too many arguments for foreign function\n");
+      args[n++] = ffi_type(a->sym);
+   }
+
+   if (ast->child->next->next)
+      ret = ffi_type(ast->child->next->next->sym);
+
+   fn.v.p = dlsym(ffi_self, name->name);
+   if (fn.v.p == NULL)
+      exception("Foreign function not found\n");
+
+   fn.type = ffi_sig(ret, n, args);
+
+   global_define(name, fn);
+
+   return fn;
+}
@@ -0,0 +1,58 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include "backend.h"
+#include "gc.h"
+
+#ifndef FFI_H
+#define FFI_H
+
+#define FFI_MAX_ARGS 4 /* most arguments a foreign function may take */
+
+#define FFI_TAB_SIZE 256
+
+#define FFI_LIBS "libm.so.6" /* searched if CESIUM_FFI_LIBS is not set */
+
+typedef value_t (*ffi_stub)(void * fn, value_t * args);
+
+typedef struct ffi_sig_t
+{
+   type_t * type; /* interned fn_type, with its stub attached */
+   struct ffi_sig_t * next;
+} ffi_sig_t;
+
+void ffi_init(void);
+
+type_t * ffi_sig(type_t * ret, int arity, type_t ** args);
+
+value_t ffi_call(value_t fn, value_t * args);
+
+value_t define_extern(ast_t * ast);
+
+#endif
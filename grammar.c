@@ -0,0 +1,209 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "grammar.h"
+
+combinator_t * grammar(void)
+{
+   combinator_t * stmt = label(new_combinator(), "stmt");
+   combinator_t * assign = label(new_combinator(), "assign");
+   combinator_t * exp = label(new_combinator(), "exp");
+   combinator_t * paren = label(new_combinator(), "paren");
+   combinator_t * base = label(new_combinator(), "base");
+   combinator_t * primary = label(new_combinator(), "primary");
+   combinator_t * lambda = label(new_combinator(), "lambda");
+   combinator_t * params = label(new_combinator(), "params");
+   combinator_t * call = label(new_combinator(), "call");
+   combinator_t * args = label(new_combinator(), "args");
+   combinator_t * index = label(new_combinator(), "index");
+   combinator_t * arr = label(new_combinator(), "arr");
+   combinator_t * slot = label(new_combinator(), "slot");
+   combinator_t * datatype = label(new_combinator(), "datatype");
+   combinator_t * foreign = label(new_combinator(), "foreign");
+   combinator_t * cond = label(new_combinator(), "cond");
+   combinator_t * import = label(new_combinator(), "import");
+
+   seq(paren, T_LIST,
+          match("("),
+          cut(),
+          exp,
+          match(")"),
+       NULL);
+
+   seq(params, T_PARAMS,
+          match("("),
+          option(seq(new_combinator(), T_NONE,
+             cident(),
+             zeroplus(T_NONE, seq(new_combinator(), T_NONE,
+                match(","),
+                cident(),
+             NULL)),
+          NULL)),
+          match(")"),
+       NULL);
+
+   seq(lambda, T_LAMBDA,
+          keyword("lambda"),
+          params,
+          exp,
+       NULL);
+
+   seq(cond, T_IF,
+          keyword("if"),
+          exp,
+          keyword("then"),
+          exp,
+          keyword("else"),
+          exp,
+       NULL);
+
+   seq(arr, T_ARRAY,
+          match("["),
+          cut(),
+          option(seq(new_combinator(), T_NONE,
+             exp,
+             zeroplus(T_NONE, seq(new_combinator(), T_NONE,
+                match(","),
+                exp,
+             NULL)),
+          NULL)),
+          match("]"),
+       NULL);
+
+   multi(primary, T_NONE, 
+          label(capture(T_DOUBLE, seq(new_combinator(), T_NONE,
+             integer(),
+             exact("."),
+             oneplus(T_NONE, digit()),
+          NULL)), "double"),
+          label(capture(T_INT, integer()), "int"),
+          lambda,
+          cond,
+          cident(),
+          paren,
+          arr,
+       NULL);
+
+   seq(args, T_ARGS,
+          match("("),
+          cut(),
+          option(seq(new_combinator(), T_NONE,
+             exp,
+             zeroplus(T_NONE, seq(new_combinator(), T_NONE,
+                match(","),
+                exp,
+             NULL)),
+          NULL)),
+          match(")"),
+       NULL);
+
+   seq(index, T_INDEX,
+          match("["),
+          cut(),
+          exp,
+          match("]"),
+       NULL);
+
+   seq(call, T_CALL,
+          primary,
+          oneplus(T_NONE, multi(new_combinator(), T_NONE,
+             args,
+             index,
+             seq(new_combinator(), T_SLOT,
+                match("."),
+                cident(),
+             NULL),
+          NULL)),
+       NULL);
+
+   multi(base, T_NONE,
+          call,
+          primary,
+       NULL);
+
+   expr(exp, base);
+
+   expr_insert(exp, 0, T_ADD, EXPR_INFIX, ASSOC_LEFT, match("+"));
+   expr_altern(exp, 0, T_SUB, match("-"));
+
+   expr_insert(exp, 1, T_MUL, EXPR_INFIX, ASSOC_LEFT, match("*"));
+   expr_altern(exp, 1, T_DIV, match("/"));
+   expr_altern(exp, 1, T_REM, match("%"));
+
+   seq(assign, T_ASSIGN,
+          cident(),
+          match("="),
+          exp,
+       NULL);
+
+   seq(slot, T_SLOT,
+          cident(),
+          option(seq(new_combinator(), T_NONE,
+             match(":"),
+             cident(),
+          NULL)),
+       NULL);
+
+   seq(datatype, T_DATATYPE,
+          keyword("type"),
+          cident(),
+          match("("),
+          slot,
+          zeroplus(T_NONE, seq(new_combinator(), T_NONE,
+             match(","),
+             slot,
+          NULL)),
+          match(")"),
+       NULL);
+
+   seq(foreign, T_EXTERN,
+          keyword("extern"),
+          cident(),
+          params,
+          option(seq(new_combinator(), T_NONE,
+             match(":"),
+             cident(),
+          NULL)),
+       NULL);
+
+   seq(import, T_IMPORT,
+          keyword("import"),
+          cident(),
+       NULL);
+
+   seq(stmt, T_NONE,
+          multi(new_combinator(), T_NONE,
+             datatype,
+             foreign,
+             import,
+             assign,
+             exp,
+          NULL),
+          match(";"),
+       NULL);
+
+   return optimise(stmt);
+}
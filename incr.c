@@ -0,0 +1,169 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "incr.h"
+
+void doc_append(doc_t * doc, int * alloc, ast_t * a)
+{
+   if (doc->num_stmts == *alloc)
+   {
+      *alloc = *alloc*2 + 16;
+      doc->stmts = (ast_t **) GC_REALLOC(doc->stmts, *alloc*sizeof(ast_t *));
+   }
+
+   doc->stmts[doc->num_stmts++] = a;
+}
+
+/* copy of an error with its offset moved by delta */
+err_t * doc_error(err_t * err, int delta)
+{
+   err_t * e = (err_t *) GC_MALLOC(sizeof(err_t));
+
+   *e = *err;
+   if (e->offset >= 0)
+      e->offset += delta;
+
+   return e;
+}
+
+/*
+   Parse statements from pos onwards. If old is given, then after each
+   statement check whether parsing has come back into step with the old
+   parse, in which case the rest of its statements are reused, shifted
+   by delta. Statements at or beyond offset limit in the new source
+   have the same text as at their old offset less delta.
+*/
+void doc_reparse(doc_t * doc, int * alloc, int pos, doc_t * old, int first,
+                                                      int limit, int delta)
+{
+   input_t * in = string_input(doc->src, doc->len);
+   ast_t * a, * b;
+   handler_t h;
+   err_t err;
+   int i = first;
+
+   doc->stop = pos;
+   doc->err = NULL;
+
+   /* errors end the parse, so are caught here and recorded */
+   if (!TRY(h))
+   {
+      doc->err = doc_error(&h.err, 0);
+      return;
+   }
+
+   in->start = pos;
+
+   while (a = parse(in, doc->stmt))
+   {
+      a->start = pos;
+      a->end = doc->stop = pos = in->start;
+      doc_append(doc, alloc, a);
+
+      if (old == NULL || pos < limit)
+         continue;
+
+      while (i < old->num_stmts && old->stmts[i]->end < pos - delta)
+         i++;
+
+      if (i < old->num_stmts && old->stmts[i]->end == pos - delta)
+      {
+         for (i++; i < old->num_stmts; i++)
+         {
+            b = new_ast();
+            *b = *old->stmts[i];
+            b->start += delta;
+            b->end += delta;
+            doc_append(doc, alloc, b);
+         }
+
+         doc->stop = old->stop + delta;
+         doc->err = old->err ? doc_error(old->err, delta) : NULL;
+
+         handler_pop(&h);
+         return;
+      }
+   }
+
+   skip_whitespace(in);
+   doc->stop = in->start;
+
+   if (doc->stop < doc->len)
+      doc->err = doc_error(syntax_err(in, &err), 0);
+
+   handler_pop(&h);
+}
+
+doc_t * doc_parse(combinator_t * stmt, char * src, int len)
+{
+   doc_t * doc = (doc_t *) GC_MALLOC(sizeof(doc_t));
+   int alloc = 0;
+
+   doc->stmt = stmt;
+   doc->src = src;
+   doc->len = len;
+
+   doc_reparse(doc, &alloc, 0, NULL, 0, 0, 0);
+
+   return doc;
+}
+
+/*
+   Return the document after replacing deleted characters at offset
+   with the inserted text. The statements before the edit are kept, as
+   a statement's parse depends only on its own text. Parsing resumes at
+   the start of the first statement the edit touches and goes on until
+   it ends a statement where the old parse did, after which the rest of
+   the old statements are reused. The old document is left unchanged.
+*/
+doc_t * doc_edit(doc_t * doc, int offset, int deleted,
+                                       const char * text, int inserted)
+{
+   doc_t * d = (doc_t *) GC_MALLOC(sizeof(doc_t));
+   int alloc = 0, i, pos;
+
+   if (offset < 0 || deleted < 0 || offset + deleted > doc->len)
+      exception("Edit out of range\n");
+
+   d->stmt = doc->stmt;
+   d->len = doc->len - deleted + inserted;
+   d->src = (char *) GC_MALLOC_ATOMIC(d->len + 1);
+
+   memcpy(d->src, doc->src, offset);
+   memcpy(d->src + offset, text, inserted);
+   memcpy(d->src + offset + inserted, doc->src + offset + deleted,
+          doc->len - offset - deleted);
+   d->src[d->len] = '\0';
+
+   for (i = 0; i < doc->num_stmts && doc->stmts[i]->end <= offset; i++)
+      doc_append(d, &alloc, doc->stmts[i]);
+
+   pos = i ? doc->stmts[i - 1]->end : 0;
+
+   doc_reparse(d, &alloc, pos, doc, i, offset + inserted, inserted - deleted);
+
+   return d;
+}
@@ -28,12 +28,34 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 input_t * new_input()
 {
-    input_t * in = GC_MALLOC(sizeof(input_t));
+    input_t * in = ALLOC(TAG_INPUT, sizeof(input_t));
 
     in->input = NULL;
     in->alloc = 0;
     in->length = 0;
     in->start = 0;
+    in->file = stdin;
+    in->fail = -1;
+    in->num_expected = 0;
+    in->cut = 0;
+    in->recognise = 0;
+
+    return in;
+}
+
+input_t * string_input(char * str, int length)
+{
+    input_t * in = ALLOC(TAG_INPUT, sizeof(input_t));
+
+    in->input = str;
+    in->alloc = length;
+    in->length = length;
+    in->start = 0;
+    in->file = NULL;
+    in->fail = -1;
+    in->num_expected = 0;
+    in->cut = 0;
+    in->recognise = 0;
 
     return in;
 }
@@ -43,14 +65,21 @@ char read1(input_t * in)
    if (in->start < in->length)
       return in->input[in->start++];
 
+   if (in->file == NULL)
+   {
+      in->start++;
+      return EOF;
+   }
+
    if (in->alloc == in->length)
    {
       in->input = realloc(in->input, in->alloc + 50);
+      alloc_note(TAG_INPUT, 50);
       in->alloc += 50;
    }
 
    in->start++;
-   return in->input[in->length++] = getchar();
+   return in->input[in->length++] = getc(in->file);
 }
 
 void skip_whitespace(input_t * in)
@@ -62,3 +91,14 @@ void skip_whitespace(input_t * in)
    in->start--;
 }
 
+/*
+   Discard the input read so far, as the REPL does after each line.
+*/
+void reset_input(input_t * in)
+{
+   in->start = 0;
+   in->length = 0;
+   in->fail = -1;
+   in->num_expected = 0;
+   in->cut = 0;
+}
@@ -24,8 +24,11 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include "gc.h"
+#include "alloc.h"
+#include "exception.h"
 
 #ifndef INPUT_H
 #define INPUT_H
@@ -36,12 +39,22 @@ typedef struct
    int alloc;
    int length;
    int start;
+   FILE * file; /* where further input comes from, NULL for strings */
+   int fail; /* furthest offset at which a token failed to match */
+   const char * expected[EXPECTED_MAX]; /* the tokens tried there */
+   int num_expected;
+   int cut; /* a cut has been passed since the innermost choice began */
+   int recognise; /* only advance over the input, building no AST */
 } input_t;
 
 input_t * new_input();
 
+input_t * string_input(char * str, int length);
+
 char read1(input_t * in);
 
 void skip_whitespace(input_t * in);
 
+void reset_input(input_t * in);
+
 #endif
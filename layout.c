@@ -0,0 +1,291 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "layout.h"
+
+slot_kind slot_kind_of(type_t * type)
+{
+   switch (type->typ)
+   {
+   case INT:
+   case DOUBLE:
+   case CHAR:
+   case BOOL:
+      return SLOT_UNBOXED;
+   case ARRAY:
+   case DATATYPE:
+      /* the type is fixed, so only the pointer need be stored */
+      return SLOT_POINTER;
+   default:
+      return SLOT_BOXED;
+   }
+}
+
+size_t slot_size(type_t * type, slot_kind kind)
+{
+   if (kind == SLOT_BOXED)
+      return sizeof(value_t);
+   else if (kind == SLOT_POINTER)
+      return sizeof(void *);
+   else
+      return array_el_size(type);
+}
+
+/*
+   Slots are placed in order of decreasing alignment, so there is no
+   padding except at the end. Slots which may hold pointers go first, so
+   that the words the collector must scan are together at the start.
+*/
+int slot_rank(type_t * type, slot_kind kind)
+{
+   if (kind != SLOT_UNBOXED)
+      return 0;
+
+   return slot_size(type, kind) == sizeof(GC_word) ? 1 : 2;
+}
+
+layout_t * type_layout(type_t * type)
+{
+   layout_t * l;
+   GC_word * bitmap;
+   size_t off = 0, words, w;
+   int n = type->arity, i, rank;
+
+   if (type->layout)
+      return type->layout;
+
+   l = (layout_t *) GC_MALLOC(sizeof(layout_t));
+   l->kinds = (slot_kind *) GC_MALLOC(n*sizeof(slot_kind));
+   l->offsets = (size_t *) GC_MALLOC(n*sizeof(size_t));
+
+   for (i = 0; i < n; i++)
+      l->kinds[i] = slot_kind_of(type->args[i]);
+
+   for (rank = 0; rank < 3; rank++)
+   {
+      for (i = 0; i < n; i++)
+      {
+         if (slot_rank(type->args[i], l->kinds[i]) == rank)
+         {
+            l->offsets[i] = off;
+            off += slot_size(type->args[i], l->kinds[i]);
+         }
+      }
+   }
+
+   words = (off + sizeof(GC_word) - 1)/sizeof(GC_word);
+   l->size = words ? words*sizeof(GC_word) : sizeof(GC_word);
+
+   bitmap = (GC_word *) GC_MALLOC((words/GC_WORDSZ + 1)*sizeof(GC_word));
+   l->atomic = 1;
+
+   for (i = 0; i < n; i++)
+   {
+      w = l->offsets[i]/sizeof(GC_word);
+
+      if (l->kinds[i] == SLOT_POINTER)
+         GC_set_bit(bitmap, w);
+      else if (l->kinds[i] == SLOT_BOXED)
+      {
+         GC_set_bit(bitmap, w);
+         GC_set_bit(bitmap, w + 1);
+      } else
+         continue;
+
+      l->atomic = 0;
+   }
+
+   if (!l->atomic)
+      l->descr = GC_make_descriptor(bitmap, words);
+
+   type->layout = l;
+
+   return l;
+}
+
+value_t new_record(type_t * type, value_t * vals)
+{
+   layout_t * l = type_layout(type);
+   type_t * t;
+   value_t rec;
+   char * p;
+   int i;
+
+   if (l->atomic)
+      rec.v.p = GC_MALLOC_ATOMIC(l->size);
+   else
+      rec.v.p = GC_MALLOC_EXPLICITLY_TYPED(l->size, l->descr);
+
+   rec.type = type;
+
+   for (i = 0; i < type->arity; i++)
+   {
+      t = type->args[i];
+      p = (char *) rec.v.p + l->offsets[i];
+
+      if (l->kinds[i] == SLOT_BOXED)
+      {
+         *((value_t *) p) = vals[i];
+         continue;
+      }
+
+      if (!type_equal(vals[i].type, t))
+         exception("Slot of wrong type in datatype constructor\n");
+
+      if (l->kinds[i] == SLOT_POINTER)
+         *((void **) p) = vals[i].v.p;
+      else if (t->typ == INT)
+         *((long *) p) = vals[i].v.i;
+      else if (t->typ == DOUBLE)
+         *((double *) p) = vals[i].v.d;
+      else
+         *p = (char) vals[i].v.i;
+   }
+
+   return rec;
+}
+
+value_t record_get(value_t rec, sym_t * slot)
+{
+   type_t * type = rec.type;
+   layout_t * l;
+   value_t val;
+   char * p;
+   int i;
+
+   if (type == NULL || type->typ != DATATYPE)
+      exception("Attempt to access slot of non-datatype\n");
+
+   for (i = 0; i < type->arity; i++)
+      if (type->slots[i] == slot)
+         break;
+
+   if (i == type->arity)
+      exception("No such slot in datatype\n");
+
+   l = type_layout(type);
+   p = (char *) rec.v.p + l->offsets[i];
+
+   if (l->kinds[i] == SLOT_BOXED)
+      return *((value_t *) p);
+
+   val.type = type->args[i];
+
+   if (l->kinds[i] == SLOT_POINTER)
+      val.v.p = *((void **) p);
+   else if (val.type->typ == INT)
+      val.v.i = *((long *) p);
+   else if (val.type->typ == DOUBLE)
+      val.v.d = *((double *) p);
+   else
+      val.v.i = *p;
+
+   return val;
+}
+
+void print_record(value_t rec)
+{
+   type_t * type = rec.type;
+   int i;
+
+   printf("%s(", type->sym->name);
+
+   for (i = 0; i < type->arity; i++)
+   {
+      if (i)
+         printf(", ");
+      print_value(record_get(rec, type->slots[i]));
+   }
+
+   printf(")");
+}
+
+type_t * slot_type(sym_t * name, type_t * self)
+{
+   value_t val = name->val;
+
+   if (name == sym_lookup("int"))
+      return t_int;
+   else if (name == sym_lookup("double"))
+      return t_double;
+   else if (name == sym_lookup("char"))
+      return t_char;
+   else if (name == sym_lookup("bool"))
+      return t_bool;
+   else if (name == self->sym)
+      return self;
+
+   /* other datatypes are named by their constructors */
+   if (val.type && val.type->typ == FN && val.v.p == NULL)
+      return val.type->ret;
+
+   exception("Unknown type in datatype definition\n");
+   return NULL;
+}
+
+value_t define_datatype(ast_t * ast)
+{
+   sym_t * name = ast->child->sym;
+   type_t ** args;
+   sym_t ** slots;
+   type_t * type;
+   ast_t * a;
+   value_t ctor;
+   int n = 0, i, j;
+
+   for (a = ast->child->next; a; a = a->next)
+      n++;
+
+   args = (type_t **) GC_MALLOC(n*sizeof(type_t *));
+   slots = (sym_t **) GC_MALLOC(n*sizeof(sym_t *));
+
+   for (i = 0, a = ast->child->next; a; a = a->next, i++)
+   {
+      slots[i] = a->child->sym;
+
+      for (j = 0; j < i; j++)
+         if (slots[j] == slots[i])
+            exception("Duplicate slot in datatype definition\n");
+   }
+
+   type = data_type(n, args, name, slots, 0, NULL);
+
+   for (i = 0, a = ast->child->next; a; a = a->next, i++)
+   {
+      if (a->child->next)
+         type->args[i] = slot_type(a->child->next->sym, type);
+      else
+         type->args[i] = new_typevar();
+   }
+
+   /* a constructor is a function without native code */
+   ctor.type = fn_type(type, n, type->args);
+   ctor.v.p = NULL;
+
+   global_define(name, ctor);
+
+   return ctor;
+}
@@ -0,0 +1,59 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "backend.h"
+#include "array.h"
+#include "gc.h"
+#include "gc_typed.h"
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+typedef enum
+{
+   SLOT_UNBOXED, SLOT_POINTER, SLOT_BOXED
+} slot_kind;
+
+typedef struct layout_t
+{
+   size_t size; /* bytes per instance */
+   slot_kind * kinds; /* representation of each slot */
+   size_t * offsets; /* offset of each slot, in declared order */
+   int atomic; /* instances contain no pointers */
+   GC_descr descr; /* which words the collector must scan */
+} layout_t;
+
+layout_t * type_layout(type_t * type);
+
+value_t new_record(type_t * type, value_t * vals);
+
+value_t record_get(value_t rec, sym_t * slot);
+
+void print_record(value_t rec);
+
+value_t define_datatype(ast_t * ast);
+
+#endif
@@ -0,0 +1,534 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "module.h"
+
+static combinator_t * module_stmt; /* grammar of a statement */
+
+static module_t * modules; /* all modules imported or being imported */
+
+void module_init(combinator_t * stmt)
+{
+   module_stmt = stmt;
+}
+
+/* FNV-1a */
+unsigned long hash_bytes(unsigned long h, const void * data, size_t len)
+{
+   const unsigned char * p = (const unsigned char *) data;
+   size_t i;
+
+   for (i = 0; i < len; i++)
+   {
+      h ^= p[i];
+      h *= 1099511628211UL;
+   }
+
+   return h;
+}
+
+char * module_path(sym_t * name)
+{
+   char * env = getenv("CESIUM_PATH");
+   char * dirs, * dir, * path;
+   FILE * f;
+
+   dirs = env ? env : MODULE_PATH;
+   dirs = strcpy((char *) GC_MALLOC_ATOMIC(strlen(dirs) + 1), dirs);
+
+   for (dir = strtok(dirs, ":"); dir; dir = strtok(NULL, ":"))
+   {
+      path = (char *) GC_MALLOC_ATOMIC(strlen(dir) + strlen(name->name) + 6);
+      sprintf(path, "%s/%s.cs", dir, name->name);
+
+      if (f = fopen(path, "r"))
+      {
+         fclose(f);
+         return path;
+      }
+   }
+
+   throw_error(ERR_IO, -1, "Module not found\n");
+   return NULL;
+}
+
+char * read_file(char * path, int * len)
+{
+   FILE * f = fopen(path, "rb");
+   char * buf;
+
+   if (f == NULL)
+      throw_error(ERR_IO, -1, "Unable to read file\n");
+
+   fseek(f, 0, SEEK_END);
+   *len = ftell(f);
+   fseek(f, 0, SEEK_SET);
+
+   buf = (char *) GC_MALLOC_ATOMIC(*len + 1);
+   *len = fread(buf, 1, *len, f);
+   buf[*len] = '\0';
+
+   fclose(f);
+
+   return buf;
+}
+
+/*
+   Cache files are written in host byte order. Every AST node is stored
+   as it is after resolution, followed by its children, so a module
+   loaded from the cache needs neither parse() nor resolve().
+*/
+void write_int(FILE * f, long n)
+{
+   fwrite(&n, sizeof(long), 1, f);
+}
+
+long read_int(reader_t * r)
+{
+   long n = 0;
+
+   if (fread(&n, sizeof(long), 1, r->f) != 1)
+      r->ok = 0;
+
+   return n;
+}
+
+void write_str(FILE * f, const char * str)
+{
+   long len = str ? strlen(str) : -1;
+
+   write_int(f, len);
+   if (len > 0)
+      fwrite(str, 1, len, f);
+}
+
+char * read_str(reader_t * r)
+{
+   long len = read_int(r);
+   char * str;
+
+   if (len < -1 || len > MODULE_MAX_STR)
+      r->ok = 0;
+
+   if (!r->ok || len == -1)
+      return NULL;
+
+   str = (char *) GC_MALLOC_ATOMIC(len + 1);
+   if (fread(str, 1, len, r->f) != len)
+      r->ok = 0;
+   str[len] = '\0';
+
+   return str;
+}
+
+/* 
+   Identify the cache format and the layout of the nodes it stores, so
+   that caches written by another version of the interpreter are ignored
+*/
+unsigned long module_format(void)
+{
+   long layout[] = { MODULE_MAGIC, MODULE_VERSION, T_IMPORT, LOC_GLOBAL,
+                     sizeof(long), sizeof(((value_t *) 0)->v) };
+
+   return hash_bytes(14695981039346656037UL, layout, sizeof(layout));
+}
+
+void write_ast(FILE * f, ast_t * ast)
+{
+   ast_t * a;
+   long n = 0;
+
+   write_int(f, ast->typ);
+   write_int(f, ast->loc);
+   write_int(f, ast->slot);
+   write_int(f, ast->tail);
+   write_str(f, ast->sym ? ast->sym->name : NULL);
+
+   if (ast->typ == T_INT || ast->typ == T_DOUBLE)
+      fwrite(&ast->val.v, sizeof(ast->val.v), 1, f);
+
+   for (a = ast->child; a; a = a->next)
+      n++;
+
+   write_int(f, n);
+   for (a = ast->child; a; a = a->next)
+      write_ast(f, a);
+}
+
+/*
+   The fewest and most children a node of each tag may have, -1 for no
+   limit, and whether its first child must be an identifier. The
+   evaluator relies on these without checking.
+*/
+static const int node_shape[][3] = {
+   [T_NONE] = { 0, -1, 0 },     [T_LIST] = { 1, -1, 0 },
+   [T_INT] = { 0, 0, 0 },       [T_DOUBLE] = { 0, 0, 0 },
+   [T_ADD] = { 2, 2, 0 },       [T_SUB] = { 2, 2, 0 },
+   [T_MUL] = { 2, 2, 0 },       [T_DIV] = { 2, 2, 0 },
+   [T_REM] = { 2, 2, 0 },       [T_IDENT] = { 0, 0, 0 },
+   [T_ASSIGN] = { 2, 2, 1 },    [T_LAMBDA] = { 2, 3, 0 },
+   [T_PARAMS] = { 0, -1, 0 },   [T_CALL] = { 1, -1, 0 },
+   [T_ARGS] = { 0, -1, 0 },     [T_CAPTURES] = { 0, -1, 0 },
+   [T_ARRAY] = { 0, -1, 0 },    [T_INDEX] = { 1, 1, 0 },
+   [T_DATATYPE] = { 1, -1, 1 }, [T_SLOT] = { 1, 2, 1 },
+   [T_EXTERN] = { 2, 3, 1 },    [T_IF] = { 3, 3, 0 },
+   [T_IMPORT] = { 1, 1, 1 }
+};
+
+/*
+   Read a node and its children. The frame b bounds the slots of the
+   variables the node refers to. It is NULL below nodes whose
+   identifiers are never resolved, such as slot names.
+*/
+ast_t * read_ast(reader_t * r, frame_bound_t * b, int depth)
+{
+   ast_t * ast = new_ast(), ** ptr, * a;
+   frame_bound_t inner, * cb = b;
+   long typ, loc, slot, tail, n, count;
+   char * name;
+
+   typ = read_int(r);
+   loc = read_int(r);
+   slot = read_int(r);
+   tail = read_int(r);
+
+   if (typ < 0 || typ > T_IMPORT || loc < 0 || loc > LOC_GLOBAL
+    || slot < 0 || slot > MODULE_MAX_SLOTS || (tail != 0 && tail != 1)
+    || depth > MODULE_MAX_DEPTH)
+      r->ok = 0;
+
+   if (!r->ok)
+      return ast;
+
+   ast->typ = typ;
+   ast->loc = loc;
+   ast->slot = slot;
+   ast->tail = tail;
+
+   if (name = read_str(r))
+      ast->sym = sym_lookup(name);
+
+   if (ast->typ == T_IDENT && ast->sym == NULL)
+      r->ok = 0;
+
+   if (b && ast->typ == T_IDENT)
+   {
+      if (ast->loc == LOC_LOCAL)
+      {
+         if (ast->slot >= b->locals)
+            r->ok = 0;
+      } else if (ast->loc == LOC_CAPTURED)
+      {
+         if (ast->slot >= b->captured)
+            b->captured = ast->slot + 1;
+      }
+   }
+
+   if (ast->typ == T_INT || ast->typ == T_DOUBLE)
+   {
+      if (fread(&ast->val.v, sizeof(ast->val.v), 1, r->f) != 1)
+         r->ok = 0;
+      ast->val.type = ast->typ == T_INT ? t_int : t_double;
+   }
+
+   count = n = read_int(r);
+   if (n < node_shape[ast->typ][0]
+    || (node_shape[ast->typ][1] >= 0 && n > node_shape[ast->typ][1]))
+      r->ok = 0;
+
+   switch (ast->typ)
+   {
+   case T_LAMBDA:
+      inner.locals = ast->slot;
+      inner.captured = 0;
+      inner.parent = b;
+      cb = b ? &inner : NULL;
+      break;
+   case T_CAPTURES:
+      /* the captured values are found in the enclosing frame */
+      if ((b && b->parent == NULL) || n != ast->slot)
+         r->ok = 0;
+      cb = b ? b->parent : NULL;
+      break;
+   case T_DATATYPE:
+   case T_EXTERN:
+   case T_IMPORT:
+   case T_SLOT:
+      cb = NULL;
+      break;
+   }
+
+   for (ptr = &ast->child; r->ok && n > 0; n--)
+   {
+      *ptr = read_ast(r, cb, depth + 1);
+      ptr = &((*ptr)->next);
+   }
+
+   if (r->ok && count && node_shape[ast->typ][2] && ast->child->typ != T_IDENT)
+      r->ok = 0;
+
+   if (r->ok && ast->typ == T_LAMBDA)
+   {
+      a = ast->child;
+      if (a->typ != T_PARAMS || (a->next->next && a->next->next->typ != T_CAPTURES))
+         r->ok = 0;
+      else if (cb && cb->captured > (a->next->next ? a->next->next->slot : 0))
+         r->ok = 0;
+      else
+         lambda_value(ast);
+   }
+
+   return ast;
+}
+
+void write_cache(char * path, unsigned long src_hash, ast_t ** stmts, int n)
+{
+   FILE * f = fopen(path, "wb");
+   int i, deps = 0;
+
+   /* the cache is only an optimisation, so failure is not an error */
+   if (f == NULL)
+      return;
+
+   write_int(f, module_format());
+   write_int(f, src_hash);
+
+   for (i = 0; i < n; i++)
+      if (stmts[i]->typ == T_IMPORT)
+         deps++;
+
+   write_int(f, deps);
+   for (i = 0; i < n; i++)
+   {
+      if (stmts[i]->typ == T_IMPORT)
+      {
+         write_str(f, stmts[i]->child->sym->name);
+         write_int(f, module_import(stmts[i]->child->sym));
+      }
+   }
+
+   write_int(f, n);
+   for (i = 0; i < n; i++)
+      write_ast(f, stmts[i]);
+
+   fclose(f);
+}
+
+/*
+   Return the statements of a module from its cache file, provided the
+   source and every module it imports are unchanged, or NULL.
+*/
+ast_t ** read_cache(char * path, unsigned long * key, unsigned long src_hash, int * n)
+{
+   frame_bound_t top = { 0, 0, NULL };
+   ast_t ** stmts = NULL;
+   unsigned long dkey;
+   long deps, i;
+   char * name;
+   handler_t h;
+   reader_t r;
+
+   /* a nested import reads its own cache through its own reader */
+   r.f = fopen(path, "rb");
+   r.ok = 1;
+
+   if (r.f == NULL)
+      return NULL;
+
+   if (read_int(&r) != module_format() || read_int(&r) != src_hash)
+      goto fail;
+
+   /* an import which fails unwinds through here, so must close f */
+   if (!TRY(h))
+   {
+      fclose(r.f);
+      throw_err(&h.err);
+   }
+
+   deps = read_int(&r);
+   for (i = 0; r.ok && i < deps; i++)
+   {
+      name = read_str(&r);
+      dkey = read_int(&r);
+
+      if (!r.ok || name == NULL || module_import(sym_lookup(name)) != dkey)
+         break;
+
+      *key = hash_bytes(*key, &dkey, sizeof(dkey));
+   }
+
+   handler_pop(&h);
+
+   if (i < deps)
+      goto fail;
+
+   *n = read_int(&r);
+   if (!r.ok || *n < 0)
+      goto fail;
+
+   stmts = (ast_t **) GC_MALLOC((*n + 1)*sizeof(ast_t *));
+   for (i = 0; r.ok && i < *n; i++)
+      stmts[i] = read_ast(&r, &top, 0);
+
+   /* there is no closure at the top level */
+   if (!r.ok || top.captured)
+      stmts = NULL;
+
+fail:
+   fclose(r.f);
+
+   return stmts;
+}
+
+ast_t ** parse_module(char * src, int len, int * n)
+{
+   input_t * in = string_input(src, len);
+   ast_t ** stmts = NULL;
+   ast_t * a;
+   int alloc = 0;
+
+   *n = 0;
+
+   while (a = parse(in, module_stmt))
+   {
+      if (*n == alloc)
+      {
+         alloc = alloc*2 + 16;
+         stmts = (ast_t **) GC_REALLOC(stmts, alloc*sizeof(ast_t *));
+      }
+
+      stmts[(*n)++] = a;
+   }
+
+   skip_whitespace(in);
+   if (in->start < in->length)
+      parse_error(in, "Syntax error in module\n");
+
+   return stmts;
+}
+
+module_t * module_find(sym_t * name)
+{
+   module_t * m;
+
+   for (m = modules; m; m = m->next)
+      if (m->name == name)
+         return m;
+
+   return NULL;
+}
+
+void module_remove(module_t * mod)
+{
+   module_t ** ptr;
+
+   for (ptr = &modules; *ptr; ptr = &((*ptr)->next))
+   {
+      if (*ptr == mod)
+      {
+         *ptr = mod->next;
+         return;
+      }
+   }
+}
+
+/*
+   Load and run a module unless it has already been imported, and
+   return its key. A module's imports are run before any of its own
+   statements, since their keys are part of its key.
+*/
+unsigned long module_import(sym_t * name)
+{
+   module_t * m = module_find(name);
+   char * path, * cpath, * src;
+   unsigned long src_hash, key;
+   ast_t ** stmts;
+   handler_t h;
+   int len, n, i, cached;
+
+   if (m)
+   {
+      if (m->loading)
+         exception("Circular import\n");
+      return m->key;
+   }
+
+   m = (module_t *) GC_MALLOC(sizeof(module_t));
+   m->name = name;
+   m->loading = 1;
+   m->next = modules;
+   modules = m;
+
+   /* a module which fails to load may be imported again */
+   if (!TRY(h))
+   {
+      module_remove(m);
+      throw_err(&h.err);
+   }
+
+   path = module_path(name);
+   src = read_file(path, &len);
+   src_hash = hash_bytes(14695981039346656037UL, src, len);
+
+   cpath = (char *) GC_MALLOC_ATOMIC(strlen(path) + 2);
+   sprintf(cpath, "%sc", path);
+
+   key = src_hash;
+   stmts = read_cache(cpath, &key, src_hash, &n);
+   cached = (stmts != NULL);
+
+   if (!cached)
+   {
+      key = src_hash;
+      stmts = parse_module(src, len, &n);
+
+      for (i = 0; i < n; i++)
+      {
+         if (stmts[i]->typ == T_IMPORT)
+         {
+            unsigned long dkey = module_import(stmts[i]->child->sym);
+            key = hash_bytes(key, &dkey, sizeof(dkey));
+         }
+      }
+   }
+
+   for (i = 0; i < n; i++)
+   {
+      if (!cached)
+         resolve_stmt(stmts[i]);
+      eval(NULL, stmts[i]);
+   }
+
+   if (!cached)
+      write_cache(cpath, src_hash, stmts, n);
+
+   handler_pop(&h);
+
+   m->key = key;
+   m->loading = 0;
+
+   return key;
+}
@@ -0,0 +1,75 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdio.h>
+#include <setjmp.h>
+#include "parser.h"
+#include "backend.h"
+#include "gc.h"
+
+#ifndef MODULE_H
+#define MODULE_H
+
+#define MODULE_MAGIC 0x31435343 /* "CSC1", hashed into the format word */
+
+#define MODULE_VERSION 2 /* bump when the cache format or ast_t changes */
+
+#define MODULE_MAX_STR 65536 /* limits on what a valid cache file holds */
+#define MODULE_MAX_SLOTS 65536
+#define MODULE_MAX_DEPTH 10000
+
+#define MODULE_PATH "." /* searched if CESIUM_PATH is not set */
+
+typedef struct module_t
+{
+   sym_t * name;
+   unsigned long key; /* hash of source and of keys of its imports */
+   int loading; /* set while being imported, to catch cycles */
+   struct module_t * next;
+} module_t;
+
+typedef struct reader_t
+{
+   FILE * f;
+   int ok; /* cleared by a short read or invalid data */
+} reader_t;
+
+typedef struct frame_bound_t
+{
+   int locals; /* slots in the frame */
+   int captured; /* closure slots referred to so far */
+   struct frame_bound_t * parent; /* frame of the enclosing lambda */
+} frame_bound_t;
+
+void module_init(combinator_t * stmt);
+
+char * read_file(char * path, int * len);
+
+void write_ast(FILE * f, ast_t * ast);
+
+unsigned long module_import(sym_t * name);
+
+#endif
@@ -0,0 +1,449 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "optimise.h"
+
+/*
+   The grammar is a graph, usually cyclic, so each pass keeps the
+   combinators it has visited. Grammars are small, so a list will do.
+*/
+typedef struct
+{
+   combinator_t ** seen;
+   int num;
+   int alloc;
+} visited_t;
+
+int visit(visited_t * v, combinator_t * c)
+{
+   int i;
+
+   for (i = 0; i < v->num; i++)
+      if (v->seen[i] == c)
+         return 1;
+
+   if (v->num == v->alloc)
+   {
+      v->alloc = 2*v->alloc + 16;
+      v->seen = (combinator_t **) GC_REALLOC(v->seen, v->alloc*sizeof(combinator_t *));
+   }
+
+   v->seen[v->num++] = c;
+
+   return 0;
+}
+
+/*
+   Whether c may pass a cut which is not inside a choice of its own, so
+   that the cut would commit a choice enclosing c.
+*/
+int naked_cut(combinator_t * c, visited_t * v)
+{
+   seq_list * l;
+   expr_list * e;
+   op_t * op;
+
+   if (visit(v, c))
+      return 0;
+
+   if (c->fn == cut_fn)
+      return 1;
+   else if (c->fn == seq_fn)
+   {
+      for (l = ((seq_args *) c->args)->list; l != NULL; l = l->next)
+         if (naked_cut(l->comb, v))
+            return 1;
+   } else if (c->fn == capture_fn)
+      return naked_cut(((capture_args *) c->args)->comb, v);
+   else if (c->fn == expect_fn)
+      return naked_cut(((expect_args *) c->args)->comb, v);
+   else if (c->fn == expr_fn)
+   {
+      for (e = (expr_list *) c->args; e != NULL; e = e->next)
+      {
+         if (e->fix == EXPR_BASE && naked_cut(e->comb, v))
+            return 1;
+
+         for (op = e->op; op != NULL; op = op->next)
+            if (naked_cut(op->comb, v))
+               return 1;
+      }
+   }
+
+   return 0;
+}
+
+int has_cut(combinator_t * c)
+{
+   visited_t v = { NULL, 0, 0 };
+
+   return naked_cut(c, &v);
+}
+
+int alts_cut(combinator_t * c)
+{
+   seq_list * l;
+
+   for (l = ((seq_args *) c->args)->list; l != NULL; l = l->next)
+      if (has_cut(l->comb))
+         return 1;
+
+   return 0;
+}
+
+/*
+   Whether c always succeeds. Only the obvious cases are found.
+*/
+int infallible(combinator_t * c, int depth)
+{
+   seq_list * l;
+
+   if (depth > 8)
+      return 0;
+
+   if (c->fn == option_fn)
+      return !has_cut((combinator_t *) c->args);
+   else if (c->fn == zeroplus_fn)
+      return !has_cut(((capture_args *) c->args)->comb);
+   else if (c->fn == seq_fn)
+   {
+      for (l = ((seq_args *) c->args)->list; l != NULL; l = l->next)
+         if (!infallible(l->comb, depth + 1))
+            return 0;
+
+      return 1;
+   }
+
+   return 0;
+}
+
+int literal(combinator_t * c)
+{
+   return c->fn == match_fn || c->fn == exact_fn;
+}
+
+/*
+   Whether a and b match the same thing, as far as can be told.
+*/
+int same(combinator_t * a, combinator_t * b)
+{
+   if (a == b)
+      return 1;
+
+   return literal(a) && a->fn == b->fn
+       && strcmp(((match_args *) a->args)->str, ((match_args *) b->args)->str) == 0;
+}
+
+/*
+   Whether an alternative b can never be reached after an alternative a
+   of the same choice, because a matches wherever b would.
+*/
+int shadows(combinator_t * a, combinator_t * b)
+{
+   char * s, * t;
+
+   if (a == b || infallible(a, 0))
+      return 1;
+
+   if (literal(a) && a->fn == b->fn)
+   {
+      s = ((match_args *) a->args)->str;
+      t = ((match_args *) b->args)->str;
+
+      return strncmp(s, t, strlen(s)) == 0;
+   }
+
+   return 0;
+}
+
+/*
+   Make c behave as d. The label, and so the profile entry, of c is kept.
+*/
+void become(combinator_t * c, combinator_t * d)
+{
+   c->fn = d->fn;
+   c->args = d->args;
+}
+
+seq_list * seq_copy(seq_list * l, seq_list * next)
+{
+   seq_list * head = NULL, ** ptr = &head;
+
+   for ( ; l != NULL; l = l->next)
+   {
+      *ptr = ALLOC(TAG_PARSER, sizeof(seq_list));
+      (*ptr)->comb = l->comb;
+      ptr = &(*ptr)->next;
+   }
+
+   *ptr = next;
+
+   return head;
+}
+
+/*
+   A nested untyped sequence at the end of a sequence produces the same
+   results inline. Elsewhere it may not, as seq_fn keeps only the first
+   node of a chain returned by any but the last element. Literals
+   following one another are fused when the second does not skip
+   whitespace, as a single literal then matches the same input.
+*/
+void optimise_seq(combinator_t * c)
+{
+   seq_args * sa = (seq_args *) c->args;
+   seq_list * l, * inner;
+   combinator_t * a, * b;
+   char * str;
+
+   for (l = sa->list; l->next != NULL; l = l->next) ;
+
+   while (l->comb != c && l->comb->fn == seq_fn
+       && ((seq_args *) l->comb->args)->typ == T_NONE)
+   {
+      inner = ((seq_args *) l->comb->args)->list;
+      l->comb = inner->comb;
+      l->next = seq_copy(inner->next, NULL);
+
+      for ( ; l->next != NULL; l = l->next) ;
+   }
+
+   for (l = sa->list; l != NULL; l = l->next)
+   {
+      while (l->next != NULL && l->next->comb->fn == exact_fn && literal(l->comb))
+      {
+         a = l->comb;
+         b = l->next->comb;
+
+         str = ALLOC_ATOMIC(TAG_PARSER, strlen(((match_args *) a->args)->str)
+                                      + strlen(((match_args *) b->args)->str) + 1);
+         strcpy(str, ((match_args *) a->args)->str);
+         strcat(str, ((match_args *) b->args)->str);
+
+         l->comb = a->fn == match_fn ? match(str) : exact(str);
+         l->next = l->next->next;
+      }
+   }
+
+   if (sa->typ == T_NONE && sa->list->next == NULL && sa->list->comb != c)
+      become(c, sa->list->comb);
+}
+
+combinator_t * first_of(combinator_t * alt)
+{
+   if (alt->fn == seq_fn)
+      return ((seq_args *) alt->args)->list->comb;
+
+   return alt;
+}
+
+/*
+   Replace the alternatives from l up to, but not including, end, which
+   all begin with the same combinator, by a choice between what follows
+   that combinator in each, which is parsed only once.
+*/
+combinator_t * factor(tag_t typ, seq_list * l, seq_list * end)
+{
+   factor_args * fa = ALLOC(TAG_PARSER, sizeof(factor_args));
+   combinator_t * comb = new_combinator();
+   factor_alt ** ptr = &fa->alts;
+
+   fa->typ = typ;
+   fa->prefix = first_of(l->comb);
+
+   for ( ; l != end; l = l->next)
+   {
+      *ptr = ALLOC(TAG_PARSER, sizeof(factor_alt));
+
+      if (l->comb->fn == seq_fn)
+      {
+         (*ptr)->typ = ((seq_args *) l->comb->args)->typ;
+         (*ptr)->rest = ((seq_args *) l->comb->args)->list->next;
+      } else
+      {
+         (*ptr)->typ = T_NONE;
+         (*ptr)->rest = NULL;
+      }
+
+      ptr = &(*ptr)->next;
+   }
+
+   *ptr = NULL;
+
+   comb->fn = factor_fn;
+   comb->args = fa;
+
+   return comb;
+}
+
+/*
+   A cut commits the innermost choice, so choices are only merged or
+   removed where no cut in them could then commit a different one.
+*/
+void optimise_multi(combinator_t * c)
+{
+   seq_args * sa = (seq_args *) c->args;
+   seq_list * l, * e, * g, * inner;
+   combinator_t * first;
+   int n, cuts;
+
+   for (l = sa->list; l != NULL; l = l->next)
+   {
+      while (l->next != NULL)
+      {
+         for (e = sa->list; e != l->next; e = e->next)
+            if (shadows(e->comb, l->next->comb))
+               break;
+
+         if (e == l->next)
+            break;
+
+         fprintf(stderr, "Unreachable alternative in %s removed\n",
+                 c->name ? c->name : "choice");
+         l->next = l->next->next;
+      }
+   }
+
+   for (l = sa->list; l != NULL; l = g)
+   {
+      first = first_of(l->comb);
+      cuts = has_cut(l->comb);
+
+      for (g = l->next, n = 1; g != NULL && same(first_of(g->comb), first); g = g->next, n++)
+         cuts |= has_cut(g->comb);
+
+      if (n < 2 || first->fn == cut_fn)
+         continue;
+
+      if (l == sa->list && g == NULL)
+      {
+         become(c, factor(sa->typ, l, NULL));
+         return;
+      }
+
+      if (!cuts)
+      {
+         l->comb = factor(T_NONE, l, g);
+         l->next = g;
+      }
+   }
+
+   for (l = sa->list; l != NULL; l = l->next)
+   {
+      while (l->comb != c && l->comb->fn == multi_fn
+          && ((seq_args *) l->comb->args)->typ == T_NONE && !alts_cut(l->comb))
+      {
+         inner = ((seq_args *) l->comb->args)->list;
+         l->comb = inner->comb;
+         l->next = seq_copy(inner->next, l->next);
+      }
+   }
+
+   if (sa->typ == T_NONE && sa->list->next == NULL
+    && sa->list->comb != c && !has_cut(sa->list->comb))
+      become(c, sa->list->comb);
+}
+
+/*
+   An optional repetition may as well be a repetition, which succeeds
+   anyway if nothing matches.
+*/
+void optimise_option(combinator_t * c)
+{
+   combinator_t * d = (combinator_t * ) c->args;
+
+   if (d->fn == option_fn && !has_cut((combinator_t *) d->args))
+      become(c, d);
+   else if (d->fn == zeroplus_fn && !has_cut(((capture_args *) d->args)->comb))
+      become(c, d);
+   else if (d->fn == oneplus_fn && !has_cut(((capture_args *) d->args)->comb))
+   {
+      c->fn = zeroplus_fn;
+      c->args = d->args;
+   }
+}
+
+void optimise_comb(combinator_t * c, visited_t * v)
+{
+   seq_list * l;
+   factor_alt * alt;
+   expr_list * e;
+   op_t * op;
+
+   if (visit(v, c))
+      return;
+
+   if (c->fn == seq_fn || c->fn == multi_fn)
+   {
+      for (l = ((seq_args *) c->args)->list; l != NULL; l = l->next)
+         optimise_comb(l->comb, v);
+   } else if (c->fn == factor_fn)
+   {
+      optimise_comb(((factor_args *) c->args)->prefix, v);
+
+      for (alt = ((factor_args *) c->args)->alts; alt != NULL; alt = alt->next)
+         for (l = alt->rest; l != NULL; l = l->next)
+            optimise_comb(l->comb, v);
+   } else if (c->fn == capture_fn || c->fn == zeroplus_fn || c->fn == oneplus_fn)
+      optimise_comb(((capture_args *) c->args)->comb, v);
+   else if (c->fn == not_fn || c->fn == option_fn)
+      optimise_comb((combinator_t *) c->args, v);
+   else if (c->fn == expect_fn)
+      optimise_comb(((expect_args *) c->args)->comb, v);
+   else if (c->fn == expr_fn)
+   {
+      for (e = (expr_list *) c->args; e != NULL; e = e->next)
+      {
+         if (e->fix == EXPR_BASE)
+            optimise_comb(e->comb, v);
+
+         for (op = e->op; op != NULL; op = op->next)
+            optimise_comb(op->comb, v);
+      }
+   }
+
+   if (c->fn == seq_fn)
+      optimise_seq(c);
+   else if (c->fn == multi_fn)
+      optimise_multi(c);
+   else if (c->fn == option_fn)
+      optimise_option(c);
+}
+
+/*
+   Simplify a grammar once it is complete, in place, without changing
+   what it accepts or the AST it builds. Nested choices, and sequences
+   ending in an untyped sequence, are flattened, adjacent literals fused, alternatives which can never
+   be reached removed, and prefixes common to neighbouring alternatives
+   parsed only once.
+*/
+combinator_t * optimise(combinator_t * root)
+{
+   visited_t v = { NULL, 0, 0 };
+
+   optimise_comb(root, &v);
+
+   return root;
+}
@@ -25,33 +25,104 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdarg.h>
+#include <ctype.h>
 #include "parser.h"
 
 extern ast_t * ast_nil;
 
+/*
+   Record that a token was tried at pos and failed. Only the tokens
+   tried at the furthest such point are kept, as that is usually where
+   the error is.
+*/
+void expected(input_t * in, int pos, const char * what)
+{
+   int i;
+
+   if (pos < in->fail)
+      return;
+
+   if (pos > in->fail)
+   {
+      in->fail = pos;
+      in->num_expected = 0;
+   }
+
+   for (i = 0; i < in->num_expected; i++)
+      if (strcmp(in->expected[i], what) == 0)
+         return;
+
+   if (in->num_expected < EXPECTED_MAX)
+      in->expected[in->num_expected++] = what;
+}
+
+/*
+   Describe a syntax error at the current point of the input, along
+   with the tokens which would have been accepted, if known.
+*/
+err_t * syntax_err(input_t * in, err_t * err)
+{
+   err->code = ERR_SYNTAX;
+   err->msg = "Syntax error\n";
+   err->offset = in->start;
+   err->num_expected = 0;
+
+   if (in->fail >= in->start)
+   {
+      err->offset = in->fail;
+      err->num_expected = in->num_expected;
+      memcpy(err->expected, in->expected, in->num_expected*sizeof(char *));
+   }
+
+   return err;
+}
+
+void parse_error(input_t * in, const char * msg)
+{
+   err_t err;
+
+   syntax_err(in, &err)->msg = msg;
+
+   throw_err(&err);
+}
+
+char * quoted(char * str)
+{
+   char * q = (char *) ALLOC_ATOMIC(TAG_PARSER, strlen(str) + 3);
+
+   sprintf(q, "'%s'", str);
+
+   return q;
+}
+
 combinator_t * new_combinator()
 {
-    combinator_t * c = GC_MALLOC(sizeof(combinator_t));
+    combinator_t * c = ALLOC(TAG_PARSER, sizeof(combinator_t));
 
     c->fn = NULL;
     c->args = NULL;
+    c->name = NULL;
+    c->prof = NULL;
 
     return c;
 }
 
 ast_t * match_fn(input_t * in, void * args)
 {
-    char * str = ((match_args *) args)->str;
+    match_args * ma = (match_args *) args;
+    char * str = ma->str;
 
-    int start = in->start;
+    int start = in->start, pos;
     int i = 0, len = strlen(str);
    
     skip_whitespace(in);
+    pos = in->start;
    
     while (i < len && str[i] == read1(in)) i++;
    
     if (i != len)
     {
+       expected(in, pos, ma->descr);
        in->start = start;
        return NULL;
     }
@@ -61,8 +132,9 @@ ast_t * match_fn(input_t * in, void * args)
 
 combinator_t * match(char * str)
 {
-    match_args * args = GC_MALLOC(sizeof(match_args));
+    match_args * args = ALLOC(TAG_PARSER, sizeof(match_args));
     args->str = str;
+    args->descr = quoted(str);
     
     combinator_t * comb = new_combinator();
     comb->fn = match_fn;
@@ -71,6 +143,45 @@ combinator_t * match(char * str)
     return comb;
 }
 
+int ident_char(char c)
+{
+    return c == '_' || isalpha(c) || isdigit(c);
+}
+
+/*
+   As match, but fails if the keyword is followed by a letter, digit or
+   underscore, so that e.g. "if" does not match the start of "iffy".
+*/
+ast_t * keyword_fn(input_t * in, void * args)
+{
+    match_args * ma = (match_args *) args;
+    int start = in->start;
+    char c;
+
+    if (!match_fn(in, args))
+       return NULL;
+
+    c = read1(in);
+    in->start--;
+
+    if (ident_char(c))
+    {
+       expected(in, in->start - strlen(ma->str), ma->descr);
+       in->start = start;
+       return NULL;
+    }
+
+    return ast_nil;
+}
+
+combinator_t * keyword(char * str)
+{
+    combinator_t * comb = match(str);
+    comb->fn = keyword_fn;
+
+    return comb;
+}
+
 ast_t * expect_fn(input_t * in, void * args)
 {
     expect_args * eargs = (expect_args *) args;
@@ -81,14 +192,14 @@ ast_t * expect_fn(input_t * in, void * args)
     if (ast = parse(in, comb))
        return ast;
     else
-       exception(eargs->msg);
+       parse_error(in, eargs->msg);
 
     return NULL;
 }
 
 combinator_t * expect(combinator_t * c, char * msg)
 {
-    expect_args * args = GC_MALLOC(sizeof(expect_args));
+    expect_args * args = ALLOC(TAG_PARSER, sizeof(expect_args));
     args->msg = msg;
     args->comb = c;
     
@@ -101,7 +212,8 @@ combinator_t * expect(combinator_t * c, char * msg)
 
 ast_t * exact_fn(input_t * in, void * args)
 {
-    char * str = ((match_args *) args)->str;
+    match_args * ma = (match_args *) args;
+    char * str = ma->str;
 
     int start = in->start;
     int i = 0, len = strlen(str);
@@ -110,6 +222,7 @@ ast_t * exact_fn(input_t * in, void * args)
    
     if (i != len)
     {
+       expected(in, start, ma->descr);
        in->start = start;
        return NULL;
     }
@@ -119,8 +232,9 @@ ast_t * exact_fn(input_t * in, void * args)
 
 combinator_t * exact(char * str)
 {
-    match_args * args = GC_MALLOC(sizeof(match_args));
+    match_args * args = ALLOC(TAG_PARSER, sizeof(match_args));
     args->str = str;
+    args->descr = quoted(str);
     
     combinator_t * comb = new_combinator();
     comb->fn = exact_fn;
@@ -131,7 +245,8 @@ combinator_t * exact(char * str)
 
 ast_t * range_fn(input_t * in, void * args)
 {
-    char * str = ((match_args *) args)->str;
+    match_args * ma = (match_args *) args;
+    char * str = ma->str;
     int start = in->start;
 
     char c = read1(in);
@@ -140,6 +255,7 @@ ast_t * range_fn(input_t * in, void * args)
        return ast_nil;
     else
     {
+       expected(in, start, ma->descr);
        in->start = start;
        return NULL;
     }
@@ -147,12 +263,15 @@ ast_t * range_fn(input_t * in, void * args)
 
 combinator_t * range(char * str)
 {
-    match_args * args = GC_MALLOC(sizeof(match_args));
+    match_args * args = ALLOC(TAG_PARSER, sizeof(match_args));
     args->str = str;
     
     if (strlen(str) != 2)
        exception("String not of length 2 in range\n");
 
+    args->descr = ALLOC_ATOMIC(TAG_PARSER, 10);
+    sprintf(args->descr, "'%c'..'%c'", str[0], str[1]);
+
     combinator_t * comb = new_combinator();
     comb->fn = range_fn;
     comb->args = args;
@@ -170,6 +289,7 @@ ast_t * alpha_fn(input_t * in, void * args)
        return ast_nil;
     else
     {
+       expected(in, start, "letter");
        in->start = start;
        return NULL;
     }
@@ -194,6 +314,7 @@ ast_t * digit_fn(input_t * in, void * args)
        return ast_nil;
     else
     {
+       expected(in, start, "digit");
        in->start = start;
        return NULL;
     }
@@ -226,12 +347,340 @@ combinator_t * anything()
     return comb;
 }
 
+ast_t * cut_fn(input_t * in, void * args)
+{
+   in->cut = 1;
+   return ast_nil;
+}
+
+/*
+   Commit to the current alternative of the innermost enclosing choice,
+   i.e. multi, option, zeroplus or oneplus. If the alternative fails
+   after the cut, the choice fails without trying any others, much as
+   a cut in Prolog or a PEG.
+*/
+combinator_t * cut()
+{
+   combinator_t * comb = new_combinator();
+   comb->fn = cut_fn;
+   comb->args = NULL;
+
+   return comb;
+}
+
+ast_t * charset_fn(input_t * in, void * args)
+{
+   charset_args * cs = (charset_args *) args;
+   int start = in->start;
+
+   if (charset_has(cs, read1(in)))
+      return ast_nil;
+
+   expected(in, start, cs->descr);
+   in->start = start;
+   return NULL;
+}
+
+/*
+   Match one character from a set given as characters and ranges, e.g.
+   "a-zA-Z_". A '-' at the start or end of the spec stands for itself.
+*/
+combinator_t * charset(char * spec)
+{
+   charset_args * args = ALLOC(TAG_PARSER, sizeof(charset_args));
+   combinator_t * comb = new_combinator();
+   unsigned char * s = (unsigned char *) spec;
+   int i, c, len = strlen(spec);
+
+   memset(args->bits, 0, sizeof(args->bits));
+
+   for (i = 0; i < len; i++)
+   {
+      if (i + 2 < len && s[i + 1] == '-')
+      {
+         for (c = s[i]; c <= s[i + 2]; c++)
+            args->bits[c >> 3] |= 1 << (c & 7);
+         i += 2;
+      } else
+         args->bits[s[i] >> 3] |= 1 << (s[i] & 7);
+   }
+
+   args->descr = ALLOC_ATOMIC(TAG_PARSER, len + 3);
+   sprintf(args->descr, "[%s]", spec);
+
+   comb->fn = charset_fn;
+   comb->args = args;
+
+   return comb;
+}
+
+/*
+   Consume a run of one or more members of the set. Characters already
+   read are scanned in place; only at the end of the buffer is more
+   input read, one character at a time.
+*/
+ast_t * span_fn(input_t * in, void * args)
+{
+   charset_args * cs = (charset_args *) args;
+   int start = in->start;
+
+   while (1)
+   {
+      while (in->start < in->length && charset_has(cs, in->input[in->start]))
+         in->start++;
+
+      if (in->start < in->length || in->file == NULL)
+         break;
+
+      if (!charset_has(cs, read1(in)))
+      {
+         in->start--;
+         break;
+      }
+   }
+
+   if (in->start == start)
+   {
+      expected(in, start, cs->descr);
+      return NULL;
+   }
+
+   return ast_nil;
+}
+
+combinator_t * span(combinator_t * set)
+{
+   combinator_t * comb = new_combinator();
+
+   if (set->fn != charset_fn)
+      exception("Span of something other than a charset\n");
+
+   comb->fn = span_fn;
+   comb->args = set->args;
+
+   return comb;
+}
+
+/*
+   Build the subtrie for the literals idx[lo..hi), which are sorted and
+   share their first depth characters. The edges of each node are
+   contiguous, and in order of their labels.
+*/
+int trie_build(literals_args * la, int * idx, int lo, int hi, int depth, 
+               int * num_nodes, int * num_edges)
+{
+   int n = (*num_nodes)++, i, j, e;
+   unsigned char c;
+
+   la->nodes[n].accept = -1;
+
+   if (la->strs[idx[lo]][depth] == '\0')
+      la->nodes[n].accept = idx[lo++];
+
+   la->nodes[n].first = *num_edges;
+   la->nodes[n].num = 0;
+
+   for (i = lo; i < hi; i++)
+      if (i == lo || la->strs[idx[i]][depth] != la->strs[idx[i - 1]][depth])
+         la->nodes[n].num++;
+
+   *num_edges += la->nodes[n].num;
+
+   for (i = lo, e = la->nodes[n].first; i < hi; i = j, e++)
+   {
+      c = la->strs[idx[i]][depth];
+      
+      for (j = i + 1; j < hi && (unsigned char) la->strs[idx[j]][depth] == c; j++) ;
+
+      la->chars[e] = c;
+      la->next[e] = trie_build(la, idx, i, j, depth + 1, num_nodes, num_edges);
+   }
+
+   return n;
+}
+
+/*
+   Match the longest of a set of literals in a single pass over the
+   input, by walking a trie of them. Input beyond the match is only read
+   while some longer literal could still match.
+*/
+ast_t * literals_fn(input_t * in, void * args)
+{
+   literals_args * la = (literals_args *) args;
+   int start = in->start, pos, end, node = 0, best = -1, e, i;
+   unsigned char c;
+   char next;
+   ast_t * ast;
+
+   skip_whitespace(in);
+   pos = in->start;
+
+   while (la->nodes[node].num)
+   {
+      c = (unsigned char) read1(in);
+
+      if (node == 0)
+         node = la->root[c];
+      else
+      {
+         trie_node * t = la->nodes + node;
+
+         for (e = t->first; e < t->first + t->num && la->chars[e] < c; e++) ;
+         
+         node = (e < t->first + t->num && la->chars[e] == c) ? la->next[e] : -1;
+      }
+
+      if (node < 0)
+         break;
+
+      if (la->nodes[node].accept >= 0)
+      {
+         /* a word may not be followed by an identifier character */
+         if (la->words && ident_char(c))
+         {
+            next = read1(in);
+            in->start--;
+
+            if (ident_char(next))
+               continue;
+         }
+
+         best = la->nodes[node].accept;
+         end = in->start;
+      }
+   }
+
+   if (best < 0)
+   {
+      for (i = 0; i < la->num; i++)
+         expected(in, pos, la->descrs[i]);
+      in->start = start;
+      return NULL;
+   }
+
+   in->start = end;
+
+   if (la->tags[best] == T_NONE || in->recognise)
+      return ast_nil;
+
+   ast = new_ast();
+   ast->typ = la->tags[best];
+   ast->sym = la->syms[best];
+
+   return ast;
+}
+
+combinator_t * literals_list(int words, char * str1, tag_t tag1, va_list list)
+{
+   literals_args * args = ALLOC(TAG_PARSER, sizeof(literals_args));
+   combinator_t * comb = new_combinator();
+   int num = 0, chars = 1, num_nodes = 0, num_edges = 0, i, j, t;
+   int * idx;
+   char * s;
+   va_list ap;
+
+   va_copy(ap, list);
+   for (s = str1; s; s = va_arg(ap, char *))
+   {
+      if (s != str1)
+         va_arg(ap, int);
+      num++;
+      chars += strlen(s);
+   }
+   va_end(ap);
+
+   args->words = words;
+
+   args->num = num;
+   args->strs = ALLOC(TAG_PARSER, num*sizeof(char *));
+   args->tags = ALLOC_ATOMIC(TAG_PARSER, num*sizeof(tag_t));
+   args->syms = ALLOC(TAG_PARSER, num*sizeof(sym_t *));
+   args->descrs = ALLOC(TAG_PARSER, num*sizeof(char *));
+   
+   va_copy(ap, list);
+   for (i = 0, s = str1; i < num; i++, s = va_arg(ap, char *))
+   {
+      if (*s == '\0')
+         exception("Empty string in literal set\n");
+
+      args->strs[i] = s;
+      args->tags[i] = i ? (tag_t) va_arg(ap, int) : tag1;
+      args->syms[i] = sym_lookup(s);
+      args->descrs[i] = quoted(s);
+   }
+   va_end(ap);
+
+   /* insertion sort, so that common prefixes are adjacent */
+   idx = ALLOC_ATOMIC(TAG_PARSER, num*sizeof(int));
+   for (i = 0; i < num; i++)
+   {
+      t = i;
+      for (j = i; j > 0 && strcmp(args->strs[idx[j - 1]], args->strs[t]) > 0; j--)
+         idx[j] = idx[j - 1];
+      idx[j] = t;
+
+      if (j > 0 && strcmp(args->strs[idx[j - 1]], args->strs[t]) == 0)
+         exception("Duplicate string in literal set\n");
+   }
+
+   /* every character of every literal adds at most one node and edge */
+   args->nodes = ALLOC_ATOMIC(TAG_PARSER, chars*sizeof(trie_node));
+   args->chars = ALLOC_ATOMIC(TAG_PARSER, chars);
+   args->next = ALLOC_ATOMIC(TAG_PARSER, chars*sizeof(int));
+
+   trie_build(args, idx, 0, num, 0, &num_nodes, &num_edges);
+
+   for (i = 0; i < 256; i++)
+      args->root[i] = -1;
+   for (i = 0; i < args->nodes[0].num; i++)
+      args->root[args->chars[i]] = args->next[i];
+
+   comb->fn = literals_fn;
+   comb->args = args;
+
+   return comb;
+}
+
+/*
+   Literals are given as string, tag pairs, terminated by NULL. The
+   literal matched is returned as a node with its tag, and its text as
+   the symbol, or as ast_nil if its tag is T_NONE. The longest literal
+   matching the input is chosen.
+*/
+combinator_t * literals(char * str1, tag_t tag1, ...)
+{
+   combinator_t * comb;
+   va_list ap;
+
+   va_start(ap, tag1);
+   comb = literals_list(0, str1, tag1, ap);
+   va_end(ap);
+
+   return comb;
+}
+
+/*
+   As literals, but for keywords: a literal ending in an identifier
+   character is not matched if one follows it, so that "if" does not
+   match the start of "iffy".
+*/
+combinator_t * keywords(char * str1, tag_t tag1, ...)
+{
+   combinator_t * comb;
+   va_list ap;
+
+   va_start(ap, tag1);
+   comb = literals_list(1, str1, tag1, ap);
+   va_end(ap);
+
+   return comb;
+}
+
 ast_t * integer_fn(input_t * in, void * args)
 {
    int start, len;
    char c, * text;
-
-   ast_t * ast = new_ast();
+   ast_t * ast;
 
    skip_whitespace(in);
 
@@ -241,26 +690,25 @@ ast_t * integer_fn(input_t * in, void * args)
 
    if (!isdigit(c))
    {
+      expected(in, start, "integer");
       in->start = start;
       return NULL;
    }
 
-   if (c == '0')
+   if (c != '0')
    {
-      ast->typ = T_INT;
-      
-      ast->sym = sym_lookup("0");
-
-      return ast;
+      while (isdigit(c = read1(in))) ;
+      in->start--;
    }
 
-   while (isdigit(c = read1(in))) ;
-   in->start--;
+   if (in->recognise)
+      return ast_nil;
 
+   ast = new_ast();
    ast->typ = T_INT;
 
    len = in->start - start;
-   text = GC_MALLOC(len + 1);
+   text = ALLOC(TAG_INPUT, len + 1);
         
    strncpy(text, in->input + start, len);
    text[len] = '\0';
@@ -283,8 +731,7 @@ ast_t * cident_fn(input_t * in, void * args)
 {
    int start, len;
    char c, * text;
-
-   ast_t * ast = new_ast();
+   ast_t * ast;
 
    skip_whitespace(in);
 
@@ -294,6 +741,7 @@ ast_t * cident_fn(input_t * in, void * args)
 
    if (c != '_' && !isalpha(c))
    {
+      expected(in, start, "identifier");
       in->start = start;
       return NULL;
    }
@@ -301,11 +749,15 @@ ast_t * cident_fn(input_t * in, void * args)
    while ((c = read1(in)) == '_' || isalpha(c) || isdigit(c)) ;
    in->start--;
 
+   if (in->recognise)
+      return ast_nil;
+
+   ast = new_ast();
    ast->typ = T_IDENT;
 
    len = in->start - start;
    
-   text = GC_MALLOC(len + 1);
+   text = ALLOC(TAG_INPUT, len + 1);
         
    strncpy(text, in->input + start, len);
    text[len] = '\0';
@@ -326,7 +778,7 @@ combinator_t * cident()
 
 seq_list * new_seq()
 {
-    return GC_MALLOC(sizeof(seq_list));
+    return ALLOC(TAG_PARSER, sizeof(seq_list));
 }
 
 ast_t * seq_fn(input_t * in, void * args)
@@ -335,10 +787,11 @@ ast_t * seq_fn(input_t * in, void * args)
     seq_args * sa = (seq_args *) args;
     seq_list * seq = sa->list;
     
-    ast_t * ret = new_ast();
-    ret->typ = sa->typ;
+    /* results are chained from a node on the stack, so failure allocates nothing */
+    ast_t head, * ret;
+    ast_t * ptr = &head;
 
-    ast_t * ptr = ret;
+    head.next = NULL;
 
     while (seq != NULL)
     {
@@ -358,12 +811,14 @@ ast_t * seq_fn(input_t * in, void * args)
         seq = seq->next;
     }
 
-    if (sa->typ == T_NONE)
-       return ret->next;
+    /* a sequence of things which produce no AST, e.g. tokens, still succeeds */
+    if (sa->typ == T_NONE || in->recognise)
+       return head.next ? head.next : ast_nil;
     else
     {
-       ret->child = ret->next;
-       ret->next = NULL;
+       ret = new_ast();
+       ret->typ = sa->typ;
+       ret->child = head.next;
        return ret;
     }
 }
@@ -380,7 +835,7 @@ combinator_t * seq(combinator_t * ret, tag_t typ, combinator_t * c1, ...)
     seq = new_seq();
     seq->comb = c1;
 
-    args = GC_MALLOC(sizeof(seq_args));
+    args = ALLOC(TAG_PARSER, sizeof(seq_args));
     args->typ = typ;
     args->list = seq;
     ret->args = (void *) args;
@@ -404,13 +859,18 @@ ast_t * multi_fn(input_t * in, void * args)
 {
     seq_list * seq = ((seq_args *) args)->list;
     tag_t typ = ((seq_args *) args)->typ;
+    int cut = in->cut;
 
     while (seq != NULL)
     {
+        in->cut = 0;
+
         ast_t * a = parse(in, seq->comb);
         if (a != NULL)
         {
-           if (typ == T_NONE)
+           in->cut = cut;
+
+           if (typ == T_NONE || in->recognise)
               return a;
            
            ast_t * res = new_ast();
@@ -418,10 +878,15 @@ ast_t * multi_fn(input_t * in, void * args)
            res->child = a;
            return res;
         }
+
+        /* the alternative failed after a cut, so the others are not tried */
+        if (in->cut)
+           break;
         
         seq = seq->next;
     }
 
+    in->cut = cut;
     return NULL;
 }
 
@@ -437,7 +902,7 @@ combinator_t * multi(combinator_t * ret, tag_t typ, combinator_t * c1, ...)
     seq = new_seq();
     seq->comb = c1;
 
-    args = GC_MALLOC(sizeof(seq_args));
+    args = ALLOC(TAG_PARSER, sizeof(seq_args));
     args->typ = typ;
     args->list = seq;
     
@@ -458,6 +923,92 @@ combinator_t * multi(combinator_t * ret, tag_t typ, combinator_t * c1, ...)
     return ret;
 }
 
+/*
+   A choice between alternatives which all begin with the same prefix,
+   as produced by the grammar optimiser. The prefix is parsed once, then
+   the rest of each alternative in turn. Results are built as by seq_fn
+   and multi_fn on the unfactored alternatives.
+*/
+ast_t * factor_fn(input_t * in, void * args)
+{
+   factor_args * fa = (factor_args *) args;
+   factor_alt * alt;
+   seq_list * seq;
+   int start = in->start, after, cut = in->cut, pcut;
+   ast_t * p, * p_next, head, * ptr, * a, * ret;
+
+   in->cut = 0;
+
+   p = parse(in, fa->prefix);
+   if (p == NULL)
+   {
+      in->cut = cut;
+      return NULL;
+   }
+
+   after = in->start;
+   pcut = in->cut;
+   p_next = p->next;
+
+   for (alt = fa->alts; alt != NULL; alt = alt->next)
+   {
+      in->start = after;
+      in->cut = pcut;
+
+      head.next = NULL;
+      ptr = &head;
+
+      if (p != ast_nil)
+      {
+         p->next = p_next;
+         head.next = p;
+         ptr = p;
+      }
+
+      for (seq = alt->rest; seq != NULL; seq = seq->next)
+      {
+         a = parse(in, seq->comb);
+         if (a == NULL)
+            break;
+
+         if (a != ast_nil)
+         {
+            ptr->next = a;
+            ptr = ptr->next;
+         }
+      }
+
+      if (seq == NULL)
+      {
+         in->cut = cut;
+
+         if (alt->typ == T_NONE || in->recognise)
+            ret = head.next ? head.next : ast_nil;
+         else
+         {
+            ret = new_ast();
+            ret->typ = alt->typ;
+            ret->child = head.next;
+         }
+
+         if (fa->typ == T_NONE || in->recognise)
+            return ret;
+
+         a = new_ast();
+         a->typ = fa->typ;
+         a->child = ret;
+         return a;
+      }
+
+      if (in->cut)
+         break;
+   }
+
+   in->start = start;
+   in->cut = cut;
+   return NULL;
+}
+
 ast_t * capture_fn(input_t * in, void * args)
 {
     capture_args * cap = (capture_args *) args;
@@ -469,9 +1020,12 @@ ast_t * capture_fn(input_t * in, void * args)
     start = in->start;
     if (parse(in, cap->comb))
     {
+        if (in->recognise)
+           return ast_nil;
+
         ast_t * a = new_ast();
         int len = in->start - start;
-        char * text = GC_MALLOC(len + 1);
+        char * text = ALLOC(TAG_INPUT, len + 1);
         
         strncpy(text, in->input + start, len);
         text[len] = '\0';
@@ -487,7 +1041,7 @@ ast_t * capture_fn(input_t * in, void * args)
 
 combinator_t * capture(tag_t typ, combinator_t * c)
 {
-    capture_args * args = GC_MALLOC(sizeof(capture_args));
+    capture_args * args = ALLOC(TAG_PARSER, sizeof(capture_args));
     args->typ = typ;
     args->comb = c;
     
@@ -501,9 +1055,13 @@ combinator_t * capture(tag_t typ, combinator_t * c)
 ast_t * not_fn(input_t * in, void * args)
 {
    combinator_t * comb = (combinator_t *) args;
-   int start = in->start;
+   int start = in->start, cut = in->cut, matched;
+
+   in->cut = 0;
+   matched = recognise(in, comb);
+   in->cut = cut;
 
-   if (parse(in, comb))
+   if (matched)
    {
       in->start = start;
       return NULL;
@@ -524,12 +1082,19 @@ ast_t * option_fn(input_t * in, void * args)
 {
    combinator_t * comb = (combinator_t *) args;
    ast_t * ast;
-   int start = in->start;
+   int cut = in->cut;
 
-   if (ast = parse(in, comb))
-      return ast;
-   else
-      return ast_nil;
+   in->cut = 0;
+   ast = parse(in, comb);
+
+   if (!ast && in->cut)
+   {
+      in->cut = cut;
+      return NULL;
+   }
+
+   in->cut = cut;
+   return ast ? ast : ast_nil;
 }
 
 combinator_t * option(combinator_t * c)
@@ -546,28 +1111,52 @@ ast_t * zeroplus_fn(input_t * in, void * args)
    capture_args * cap = (capture_args *) args;
    combinator_t * comb = cap->comb;
    
-   ast_t * ast;
-   ast_t ** ptr = &ast;
+   ast_t head, * ptr = &head, * a;
+   int start = in->start, cut = in->cut, n = 0;
+
+   head.next = NULL;
+
+   /* each iteration is an alternative to stopping, so gets its own cut */
+   while (1)
+   {
+      in->cut = 0;
+      if ((a = parse(in, comb)) == NULL)
+         break;
 
-   while ((*ptr) = parse(in, comb))
-      ptr = &((*ptr)->next);
+      if (a != ast_nil)
+      {
+         ptr->next = a;
+         ptr = ptr->next;
+      }
+      n++;
+   }
+   ptr->next = NULL;
    
-   if (ast == NULL)
+   if (in->cut)
+   {
+      in->cut = cut;
+      in->start = start;
+      return NULL;
+   }
+
+   in->cut = cut;
+
+   if (n == 0)
       return ast_nil;
-   else if (cap->typ == T_NONE)
-      return ast;
+   else if (cap->typ == T_NONE || in->recognise)
+      return head.next ? head.next : ast_nil;
    else
    {
       ast_t * res = new_ast();
       res->typ = cap->typ;
-      res->child = ast;
+      res->child = head.next;
       return res;
    }
 }
 
 combinator_t * zeroplus(tag_t typ, combinator_t * c)
 {
-    capture_args * args = GC_MALLOC(sizeof(capture_args));
+    capture_args * args = ALLOC(TAG_PARSER, sizeof(capture_args));
     args->typ = typ;
     args->comb = c;
     
@@ -583,31 +1172,50 @@ ast_t * oneplus_fn(input_t * in, void * args)
    capture_args * cap = (capture_args *) args;
    combinator_t * comb = cap->comb;
    
-   ast_t * ast;
-   ast_t ** ptr = &ast;
+   ast_t head, * ptr = &head, * a;
+   int start = in->start, cut = in->cut, n = 0;
 
-   ast = parse(in, comb);
-   if (!ast)
-      return ast_nil;
-   ptr = &(ast->next);
-   
-   while ((*ptr) = parse(in, comb))
-      ptr = &((*ptr)->next);
-   
-   if (cap->typ == T_NONE)
-      return ast;
+   head.next = NULL;
+
+   /* each iteration is an alternative to stopping, so gets its own cut */
+   while (1)
+   {
+      in->cut = 0;
+      if ((a = parse(in, comb)) == NULL)
+         break;
+
+      if (a != ast_nil)
+      {
+         ptr->next = a;
+         ptr = ptr->next;
+      }
+      n++;
+   }
+   ptr->next = NULL;
+
+   if (n == 0 || in->cut)
+   {
+      in->cut = cut;
+      in->start = start;
+      return NULL;
+   }
+
+   in->cut = cut;
+
+   if (cap->typ == T_NONE || in->recognise)
+      return head.next ? head.next : ast_nil;
    else
    {
       ast_t * res = new_ast();
       res->typ = cap->typ;
-      res->child = ast;
+      res->child = head.next;
       return res;
    }
 }
 
 combinator_t * oneplus(tag_t typ, combinator_t * c)
 {
-    capture_args * args = GC_MALLOC(sizeof(capture_args));
+    capture_args * args = ALLOC(TAG_PARSER, sizeof(capture_args));
     args->typ = typ;
     args->comb = c;
     
@@ -651,9 +1259,10 @@ ast_t * expr_fn(input_t * in, void * args)
 
             rhs = expr_fn(in, (void *) list->next);
             if (!rhs)
-               exception("Expression expected!\n");
+               parse_error(in, "Expression expected!\n");
 
-            lhs = ast2(op->tag, lhs, rhs);
+            if (!in->recognise)
+               lhs = ast2(op->tag, lhs, rhs);
          }
 
          return lhs;
@@ -682,10 +1291,13 @@ ast_t * expr_fn(input_t * in, void * args)
 
             rhs = expr_fn(in, (void *) list->next);
             if (!rhs)
-               exception("Expression expected!\n");
+               parse_error(in, "Expression expected!\n");
 
-            (*ptr) = ast2(op->tag, *ptr, rhs);
-            ptr = &((*ptr)->child->next);
+            if (!in->recognise)
+            {
+               (*ptr) = ast2(op->tag, *ptr, rhs);
+               ptr = &((*ptr)->child->next);
+            }
          }
 
          return lhs;
@@ -705,9 +1317,9 @@ ast_t * expr_fn(input_t * in, void * args)
       
       rhs = expr_fn(in, (void *) list->next);
       if (op && !rhs)
-         exception("Expression expected!\n");
+         parse_error(in, "Expression expected!\n");
 
-      if (op)
+      if (op && !in->recognise)
          return ast1(op->tag, rhs);
       else
          return rhs;
@@ -725,7 +1337,7 @@ ast_t * expr_fn(input_t * in, void * args)
          op = op->next;
       }
       
-      if (op)
+      if (op && !in->recognise)
          return ast1(op->tag, lhs);
       else
          return lhs;
@@ -734,7 +1346,7 @@ ast_t * expr_fn(input_t * in, void * args)
 
 combinator_t * expr(combinator_t * exp, combinator_t * base)
 {
-   expr_list * args = GC_MALLOC(sizeof(expr_list));
+   expr_list * args = ALLOC(TAG_PARSER, sizeof(expr_list));
    args->next = NULL;
    args->fix = EXPR_BASE;
    args->comb = base;
@@ -751,8 +1363,8 @@ void expr_insert(combinator_t * expr, int prec, tag_t tag, expr_fix fix,
    expr_list * list = (expr_list *) expr->args;
    int i;
 
-   expr_list * node = GC_MALLOC(sizeof(expr_list));
-   op_t * op = GC_MALLOC(sizeof(op_t));
+   expr_list * node = ALLOC(TAG_PARSER, sizeof(expr_list));
+   op_t * op = ALLOC(TAG_PARSER, sizeof(op_t));
 
    op->tag = tag;
    op->comb = comb;
@@ -779,7 +1391,7 @@ void expr_insert(combinator_t * expr, int prec, tag_t tag, expr_fix fix,
 
 void expr_altern(combinator_t * expr, int prec, tag_t tag, combinator_t * comb)
 {
-   op_t * op = GC_MALLOC(sizeof(op_t));
+   op_t * op = ALLOC(TAG_PARSER, sizeof(op_t));
    expr_list * list = (expr_list *) expr->args;
    int i;
 
@@ -795,7 +1407,239 @@ void expr_altern(combinator_t * expr, int prec, tag_t tag, combinator_t * comb)
    list->op = op;
 }
 
+combinator_t * label(combinator_t * c, char * name)
+{
+   c->name = name;
+
+   return c;
+}
+
+/*
+   Profiling is switched on by setting CESIUM_PROFILE. Each combinator
+   then gets counts, kept in a list for the report. Counts are updated
+   without locking, so are only approximate if several threads parse.
+*/
+int parse_profiling = 0;
+
+prof_t * prof_list = NULL;
+int prof_num = 0;
+pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+
+__thread int prof_far; /* furthest point reached by a successful parse */
+__thread long prof_nested; /* time spent in nested combinators */
+
+/* nanoseconds, so that times can be added atomically */
+long prof_clock(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t);
+
+   return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+/*
+   Unlabelled combinators are named by kind, and matches by their text.
+*/
+char * prof_name(combinator_t * c, int id)
+{
+   static struct { comb_fn fn; char * kind; } kinds[] =
+   {
+      { match_fn, "match" }, { keyword_fn, "keyword" },
+      { exact_fn, "exact" }, { range_fn, "range" },
+      { expect_fn, "expect" }, { alpha_fn, "alpha" }, { digit_fn, "digit" },
+      { anything_fn, "anything" }, { integer_fn, "integer" },
+      { cident_fn, "cident" }, { seq_fn, "seq" }, { multi_fn, "multi" },
+      { capture_fn, "capture" }, { not_fn, "not" }, { option_fn, "option" },
+      { zeroplus_fn, "zeroplus" }, { oneplus_fn, "oneplus" },
+      { expr_fn, "expr" }, { charset_fn, "charset" }, { span_fn, "span" },
+      { literals_fn, "literals" }, { cut_fn, "cut" },
+      { factor_fn, "factor" }
+   };
+   char * kind = "combinator", * str = "", * name;
+   int i;
+
+   if (c->name)
+      return c->name;
+
+   for (i = 0; i < sizeof(kinds)/sizeof(kinds[0]); i++)
+      if (kinds[i].fn == c->fn)
+         kind = kinds[i].kind;
+
+   if (c->fn == match_fn || c->fn == keyword_fn || c->fn == exact_fn 
+    || c->fn == range_fn)
+      str = ((match_args *) c->args)->str;
+   else if (c->fn == charset_fn || c->fn == span_fn)
+      str = ((charset_args *) c->args)->descr;
+
+   name = (char *) GC_MALLOC_ATOMIC(strlen(kind) + strlen(str) + 16);
+
+   if (*str)
+      sprintf(name, "%s \"%s\"", kind, str);
+   else
+      sprintf(name, "%s #%d", kind, id);
+
+   return name;
+}
+
+prof_t * prof_get(combinator_t * c)
+{
+   prof_t * p = __atomic_load_n(&c->prof, __ATOMIC_ACQUIRE);
+
+   if (p)
+      return p;
+
+   pthread_mutex_lock(&prof_lock);
+
+   if ((p = c->prof) == NULL)
+   {
+      p = (prof_t *) GC_MALLOC(sizeof(prof_t));
+      p->comb = c;
+      p->name = prof_name(c, prof_num++);
+      p->next = prof_list;
+      prof_list = p;
+
+      __atomic_store_n(&c->prof, p, __ATOMIC_RELEASE);
+   }
+
+   pthread_mutex_unlock(&prof_lock);
+
+   return p;
+}
+
+/*
+   A failed parse is charged with the input it read before giving up,
+   as far as its nested combinators got. The time of a combinator which
+   recurses into itself, e.g. an expression in parentheses, is counted
+   once per level, but its self time is not. Threads parsing at once
+   share the counts, so they are updated atomically.
+*/
+ast_t * parse_profiled(input_t * in, combinator_t * comb)
+{
+   prof_t * p = prof_get(comb);
+   int start = in->start, far = prof_far;
+   long nested = prof_nested, t = prof_clock();
+   ast_t * a;
+
+   prof_far = start;
+   prof_nested = 0;
+
+   a = comb->fn(in, (void *) comb->args);
+
+   t = prof_clock() - t;
+
+   __atomic_fetch_add(&p->calls, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&p->time, t, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&p->self, t - prof_nested, __ATOMIC_RELAXED);
+
+   if (a)
+   {
+      __atomic_fetch_add(&p->hits, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&p->consumed, in->start - start, __ATOMIC_RELAXED);
+
+      if (in->start > prof_far)
+         prof_far = in->start;
+   } else
+   {
+      __atomic_fetch_add(&p->misses, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&p->rewound, prof_far - start, __ATOMIC_RELAXED);
+   }
+
+   if (far > prof_far)
+      prof_far = far;
+
+   prof_nested = nested + t;
+
+   return a;
+}
+
 ast_t * parse(input_t * in, combinator_t * comb)
 {
-    return comb->fn(in, (void *)comb->args);
+   if (parse_profiling)
+      return parse_profiled(in, comb);
+
+   return comb->fn(in, (void *)comb->args);
+}
+
+/*
+   Check whether the input matches, advancing over it if so, without
+   building any AST. Errors raised while recognising are passed on.
+*/
+int recognise(input_t * in, combinator_t * comb)
+{
+   int rec = in->recognise;
+   handler_t h;
+   ast_t * a;
+
+   in->recognise = 1;
+
+   if (!TRY(h))
+   {
+      in->recognise = rec;
+      throw_err(&h.err);
+   }
+
+   a = parse(in, comb);
+
+   handler_pop(&h);
+   in->recognise = rec;
+
+   return a != NULL;
+}
+
+int prof_cmp(const void * a, const void * b)
+{
+   long x = (*(prof_t **) a)->self, y = (*(prof_t **) b)->self;
+
+   return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/*
+   Print the counts for each combinator used, most self time first.
+*/
+void parse_profile_report(FILE * out)
+{
+   prof_t ** tab;
+   prof_t * p;
+   int n = 0, i;
+
+   pthread_mutex_lock(&prof_lock);
+
+   tab = (prof_t **) GC_MALLOC((prof_num + 1)*sizeof(prof_t *));
+   for (p = prof_list; p; p = p->next)
+      tab[n++] = p;
+
+   pthread_mutex_unlock(&prof_lock);
+
+   qsort(tab, n, sizeof(prof_t *), prof_cmp);
+
+   fprintf(out, "%-24s %10s %10s %10s %10s %10s %10s %10s\n", "combinator",
+           "calls", "hits", "misses", "consumed", "rewound", "time ms",
+           "self ms");
+
+   for (i = 0; i < n; i++)
+   {
+      p = tab[i];
+
+      if (p->calls == 0)
+         continue;
+
+      fprintf(out, "%-24s %10ld %10ld %10ld %10ld %10ld %10.3f %10.3f\n",
+              p->name, p->calls, p->hits, p->misses, p->consumed,
+              p->rewound, p->time*1e-6, p->self*1e-6);
+   }
+}
+
+void prof_exit(void)
+{
+   parse_profile_report(stderr);
+}
+
+void parse_profile_init(void)
+{
+   if (getenv("CESIUM_PROFILE"))
+   {
+      parse_profiling = 1;
+      atexit(prof_exit);
+   }
 }
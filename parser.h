@@ -25,6 +25,8 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include "input.h"
 #include "exception.h"
 #include "symbol.h"
@@ -40,11 +42,30 @@ typedef struct
 {
     comb_fn fn;
     void * args;
+    char * name; /* label, for the profile */
+    struct prof_t * prof; /* counts, once profiled */
 } combinator_t;
 
+typedef struct prof_t
+{
+   combinator_t * comb;
+   char * name;
+   long calls;
+   long hits;
+   long misses;
+   long consumed; /* bytes consumed by successful parses */
+   long rewound; /* bytes read and given back by failed parses */
+   long time; /* nanoseconds, including nested combinators */
+   long self; /* nanoseconds, excluding nested combinators */
+   struct prof_t * next;
+} prof_t;
+
+extern int parse_profiling;
+
 typedef struct
 {
     char * str;
+    char * descr; /* as reported in syntax errors */
 } match_args;
 
 typedef struct
@@ -53,6 +74,36 @@ typedef struct
     char * msg;
 } expect_args;
 
+typedef struct
+{
+   unsigned char bits[32]; /* bit c of the table is set if c is a member */
+   char * descr;
+} charset_args;
+
+#define charset_has(cs, c) \
+   ((cs)->bits[(unsigned char) (c) >> 3] & (1 << ((unsigned char) (c) & 7)))
+
+typedef struct
+{
+   int accept; /* literal ending here, or -1 */
+   int first; /* first outgoing edge */
+   int num; /* number of outgoing edges */
+} trie_node;
+
+typedef struct
+{
+   trie_node * nodes; /* node 0 is the root */
+   unsigned char * chars; /* edge labels */
+   int * next; /* edge targets */
+   int root[256]; /* target of the root edge for each character, or -1 */
+   int num; /* number of literals */
+   int words; /* literals may not be followed by identifier characters */
+   char ** strs;
+   tag_t * tags;
+   sym_t ** syms;
+   char ** descrs;
+} literals_args;
+
 typedef struct seq_list
 {
     combinator_t * comb;
@@ -71,6 +122,20 @@ typedef struct
     combinator_t * comb;
 } capture_args;
 
+typedef struct factor_alt
+{
+   tag_t typ;
+   seq_list * rest; /* what follows the prefix, possibly nothing */
+   struct factor_alt * next;
+} factor_alt;
+
+typedef struct
+{
+   tag_t typ; /* of the choice as a whole */
+   combinator_t * prefix;
+   factor_alt * alts;
+} factor_args;
+
 typedef enum
 {
    EXPR_BASE, EXPR_INFIX, EXPR_PREFIX, EXPR_POSTFIX
@@ -98,10 +163,31 @@ typedef struct expr_list
    struct expr_list * next;
 } expr_list;
 
+/* combinator functions, for passes over a grammar */
+
+ast_t * match_fn(input_t * in, void * args);
+ast_t * keyword_fn(input_t * in, void * args);
+ast_t * exact_fn(input_t * in, void * args);
+ast_t * expect_fn(input_t * in, void * args);
+ast_t * cut_fn(input_t * in, void * args);
+ast_t * seq_fn(input_t * in, void * args);
+ast_t * multi_fn(input_t * in, void * args);
+ast_t * factor_fn(input_t * in, void * args);
+ast_t * capture_fn(input_t * in, void * args);
+ast_t * not_fn(input_t * in, void * args);
+ast_t * option_fn(input_t * in, void * args);
+ast_t * zeroplus_fn(input_t * in, void * args);
+ast_t * oneplus_fn(input_t * in, void * args);
+ast_t * expr_fn(input_t * in, void * args);
+
 combinator_t * new_combinator();
 
+combinator_t * label(combinator_t * c, char * name);
+
 combinator_t * match(char * str);
 
+combinator_t * keyword(char * str);
+
 combinator_t * exact(char * str);
 
 combinator_t * integer();
@@ -116,6 +202,16 @@ combinator_t * digit();
 
 combinator_t * anything();
 
+combinator_t * cut();
+
+combinator_t * charset(char * spec);
+
+combinator_t * span(combinator_t * set);
+
+combinator_t * literals(char * str1, tag_t tag1, ...);
+
+combinator_t * keywords(char * str1, tag_t tag1, ...);
+
 combinator_t * expect(combinator_t * comb, char * msg);
 
 combinator_t * seq(combinator_t * ret, tag_t typ, combinator_t * c1, ...);
@@ -134,6 +230,21 @@ combinator_t * oneplus(tag_t typ, combinator_t * c);
 
 combinator_t * expr(combinator_t * exp, combinator_t * base);
 
+void expr_insert(combinator_t * expr, int prec, tag_t tag, expr_fix fix, 
+                 expr_assoc assoc, combinator_t * comb);
+
+void expr_altern(combinator_t * expr, int prec, tag_t tag, combinator_t * comb);
+
 ast_t * parse(input_t * in, combinator_t * comb);
 
+int recognise(input_t * in, combinator_t * comb);
+
+err_t * syntax_err(input_t * in, err_t * err);
+
+void parse_error(input_t * in, const char * msg);
+
+void parse_profile_init(void);
+
+void parse_profile_report(FILE * out);
+
 #endif
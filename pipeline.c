@@ -0,0 +1,258 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "pipeline.h"
+
+void queue_init(queue_t * q)
+{
+   q->head = 0;
+   q->count = 0;
+   pthread_mutex_init(&q->lock, NULL);
+   pthread_cond_init(&q->not_empty, NULL);
+   pthread_cond_init(&q->not_full, NULL);
+}
+
+void queue_push(queue_t * q, ast_t * ast, err_t * err)
+{
+   item_t * item;
+
+   pthread_mutex_lock(&q->lock);
+
+   while (q->count == QUEUE_SIZE)
+      pthread_cond_wait(&q->not_full, &q->lock);
+
+   item = q->items + (q->head + q->count) % QUEUE_SIZE;
+   item->ast = ast;
+   item->err = err;
+   q->count++;
+
+   pthread_cond_signal(&q->not_empty);
+   pthread_mutex_unlock(&q->lock);
+}
+
+item_t queue_pop(queue_t * q)
+{
+   item_t item;
+
+   pthread_mutex_lock(&q->lock);
+
+   while (q->count == 0)
+      pthread_cond_wait(&q->not_empty, &q->lock);
+
+   item = q->items[q->head];
+   q->head = (q->head + 1) % QUEUE_SIZE;
+   q->count--;
+
+   pthread_cond_signal(&q->not_full);
+   pthread_mutex_unlock(&q->lock);
+
+   return item;
+}
+
+/*
+   Errors raised on a stage thread are kept, to be printed by the
+   execute stage in statement order.
+*/
+err_t * keep_error(err_t * err)
+{
+   err_t * e = (err_t *) GC_MALLOC(sizeof(err_t));
+
+   *e = *err;
+
+   return e;
+}
+
+/*
+   Push the next statement, or the error which stopped parsing, or the
+   end of input. Each call pushes exactly one item, so a stage which
+   could not be given a thread can be run a step at a time by the
+   execute stage. Returns 0 once the end has been pushed.
+*/
+int parse_step(pipeline_t * p)
+{
+   handler_t h;
+   err_t err;
+   ast_t * a;
+   int more = 1;
+
+   if (p->in == NULL)
+   {
+      queue_push(&p->parsed, NULL, NULL);
+      return 0;
+   }
+
+   if (!TRY(h))
+   {
+      queue_push(&p->parsed, NULL, keep_error(&h.err));
+      p->in = NULL;
+      return 1;
+   }
+
+   if (a = parse(p->in, p->stmt))
+      queue_push(&p->parsed, a, NULL);
+   else
+   {
+      skip_whitespace(p->in);
+      if (p->in->start < p->in->length)
+         queue_push(&p->parsed, NULL, keep_error(syntax_err(p->in, &err)));
+      else
+      {
+         queue_push(&p->parsed, NULL, NULL);
+         more = 0;
+      }
+      p->in = NULL;
+   }
+
+   handler_pop(&h);
+
+   return more;
+}
+
+void * parse_stage(void * arg)
+{
+   pipeline_t * p = (pipeline_t *) arg;
+
+   while (parse_step(p)) ;
+
+   return NULL;
+}
+
+/*
+   Globals are defined only when statements are executed, which may not
+   have happened yet, so unknown globals are left for the execute stage.
+   Returns 0 once the end of input has been passed on.
+*/
+int resolve_step(pipeline_t * p)
+{
+   item_t item = queue_pop(&p->parsed);
+   int defer = defer_unknown;
+   handler_t h;
+
+   defer_unknown = 1;
+
+   if (item.ast == NULL)
+      queue_push(&p->resolved, NULL, item.err);
+   else if (!TRY(h))
+      queue_push(&p->resolved, NULL, keep_error(&h.err));
+   else
+   {
+      resolve_stmt(item.ast);
+      handler_pop(&h);
+      queue_push(&p->resolved, item.ast, NULL);
+   }
+
+   defer_unknown = defer;
+
+   return item.ast || item.err;
+}
+
+void * resolve_stage(void * arg)
+{
+   pipeline_t * p = (pipeline_t *) arg;
+
+   while (resolve_step(p)) ;
+
+   return NULL;
+}
+
+/*
+   Run a script with parsing, resolution and execution overlapped, each
+   on its own thread, linked by bounded queues. Statements still run
+   one at a time in order, and errors are reported in order. A parse
+   error ends the script; other errors are reported and the script
+   carries on, as at the REPL. Returns the number of errors.
+*/
+int pipeline_run(combinator_t * stmt, char * path)
+{
+   pthread_t parser, resolver;
+   int parse_thread, resolve_thread;
+   pipeline_t * p;
+   handler_t h;
+   value_t val;
+   item_t item;
+   volatile int errors = 0;
+
+   p = (pipeline_t *) GC_MALLOC(sizeof(pipeline_t));
+   p->stmt = stmt;
+
+   if (!TRY(h))
+   {
+      print_error(stderr, &h.err);
+      return 1;
+   }
+
+   p->src = read_file(path, &p->len);
+   handler_pop(&h);
+
+   p->in = string_input(p->src, p->len);
+
+   queue_init(&p->parsed);
+   queue_init(&p->resolved);
+
+   /* a stage without a thread is run here, one step per statement */
+   parse_thread = !pthread_create(&parser, NULL, parse_stage, p);
+   resolve_thread = !pthread_create(&resolver, NULL, resolve_stage, p);
+
+   while (1)
+   {
+      if (!parse_thread)
+         parse_step(p);
+      if (!resolve_thread)
+         resolve_step(p);
+
+      item = queue_pop(&p->resolved);
+
+      if (item.ast == NULL)
+      {
+         if (item.err == NULL)
+            break;
+
+         print_error(stderr, item.err);
+         errors++;
+      } else if (!TRY(h))
+      {
+         print_error(stderr, &h.err);
+         errors++;
+      } else
+      {
+         val = eval(NULL, item.ast);
+         handler_pop(&h);
+
+         if (val.type && val.type != t_nil)
+         {
+            print_value(val);
+            printf("\n");
+         }
+      }
+   }
+
+   if (parse_thread)
+      pthread_join(parser, NULL);
+   if (resolve_thread)
+      pthread_join(resolver, NULL);
+
+   return errors;
+}
@@ -0,0 +1,67 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#define GC_THREADS /* so threads are registered with the collector */
+#include <pthread.h>
+#include "parser.h"
+#include "backend.h"
+#include "module.h"
+#include "gc.h"
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#define QUEUE_SIZE 256 /* statements in flight between two stages */
+
+typedef struct item_t
+{
+   ast_t * ast; /* statement, NULL at end of input or on error */
+   err_t * err; /* error to report in place of the statement */
+} item_t;
+
+typedef struct queue_t
+{
+   item_t items[QUEUE_SIZE];
+   int head;
+   int count;
+   pthread_mutex_t lock;
+   pthread_cond_t not_empty;
+   pthread_cond_t not_full;
+} queue_t;
+
+typedef struct pipeline_t
+{
+   combinator_t * stmt;
+   char * src;
+   int len;
+   input_t * in; /* NULL once parsing has stopped */
+   queue_t parsed; /* parse stage to resolve stage */
+   queue_t resolved; /* resolve stage to execute stage */
+} pipeline_t;
+
+int pipeline_run(combinator_t * stmt, char * path);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "repl.h"
+
+const char * phase_names[PHASES] =
+{
+   "input", "parse", "resolve", "eval", "print"
+};
+
+/*
+   REPL commands start with a colon and take the rest of the line.
+*/
+void repl_command(input_t * in)
+{
+   char name[32];
+   int i = 0;
+   char c;
+
+   read1(in);
+
+   while ((c = read1(in)) != '\n' && c != (char) EOF)
+      if (i < sizeof(name) - 1 && c != ' ' && c != '\t')
+         name[i++] = c;
+
+   name[i] = '\0';
+
+   if (strcmp(name, "profile") == 0)
+   {
+      if (parse_profiling)
+         parse_profile_report(stdout);
+      else
+         printf("Parser profiling is off, set CESIUM_PROFILE to enable it\n");
+   } else if (strcmp(name, "alloc") == 0)
+      alloc_report(stdout);
+   else
+      printf("Unknown command :%s\n", name);
+}
+
+double repl_clock(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/* charge the time since *t to the given phase */
+void lap(double * times, repl_phase phase, volatile double * t)
+{
+   double now;
+
+   if (times == NULL)
+      return;
+
+   now = repl_clock();
+   times[phase] += now - *t;
+   *t = now;
+}
+
+/*
+   Read, evaluate and print one statement or command, then reset the
+   input for the next. Errors, including text which is not a statement,
+   are reported and skip the rest of the line. Returns 0 at the end of
+   the input. If times is not NULL, it is set
+   to the time spent in each phase. Input is read as it is parsed, so
+   the input phase covers only the wait for a statement to start, and
+   skipping the rest of a line after an error.
+*/
+int repl_step(input_t * in, combinator_t * stmt, double * times)
+{
+   volatile double t = 0;
+   volatile repl_phase phase = PHASE_INPUT;
+   handler_t h;
+   err_t err;
+   value_t val;
+   ast_t * a;
+   char c;
+   int more = 1;
+
+   if (times)
+   {
+      memset(times, 0, PHASES*sizeof(double));
+      t = repl_clock();
+   }
+
+   if (TRY(h))
+   {
+      skip_whitespace(in);
+
+      if (in->input[in->start] == ':')
+         repl_command(in);
+      else
+      {
+         lap(times, PHASE_INPUT, &t);
+
+         phase = PHASE_PARSE;
+         a = parse(in, stmt);
+         lap(times, PHASE_PARSE, &t);
+
+         if (a)
+         {
+            phase = PHASE_RESOLVE;
+            resolve_stmt(a);
+            lap(times, PHASE_RESOLVE, &t);
+
+            phase = PHASE_EVAL;
+            val = eval(NULL, a);
+            lap(times, PHASE_EVAL, &t);
+
+            phase = PHASE_PRINT;
+            print_value(val);
+            printf("\n");
+         } else if (in->input[in->start] != (char) EOF)
+            throw_err(syntax_err(in, &err));
+         else
+            more = 0;
+      }
+
+      handler_pop(&h);
+   } else
+   {
+      lap(times, phase, &t);
+      phase = PHASE_INPUT;
+
+      print_error(stderr, &h.err);
+
+      while ((c = read1(in)) != '\n' && c != (char) EOF) ;
+      printf("\n");
+   }
+
+   lap(times, phase, &t);
+
+   reset_input(in);
+
+   return more;
+}
@@ -0,0 +1,157 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "server.h"
+
+/*
+   The socket named by CESIUM_SOCKET, otherwise one per user, in a
+   directory in /tmp which only that user may enter. The directory is
+   created if need be. If it exists but is not private to the user,
+   someone else may be listening in it, so we give up.
+*/
+char * server_socket(void)
+{
+   static char path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+   char * env = getenv("CESIUM_SOCKET");
+   struct stat st;
+   int len;
+
+   if (env)
+      return env;
+
+   len = snprintf(path, sizeof(path), SERVER_DIR, (int) getuid());
+
+   if (mkdir(path, 0700) < 0 && errno != EEXIST)
+   {
+      perror(path);
+      exit(1);
+   }
+
+   if (lstat(path, &st) < 0 || !S_ISDIR(st.st_mode)
+      || st.st_uid != getuid() || (st.st_mode & 077))
+   {
+      fprintf(stderr, "%s is not a private directory\n", path);
+      exit(1);
+   }
+
+   snprintf(path + len, sizeof(path) - len, "/%s", SERVER_SOCKET);
+
+   return path;
+}
+
+/*
+   Remove a socket left behind by a server which has gone. Returns 0 if
+   a server still answers on it, or something other than a socket is in
+   the way.
+*/
+int server_clear(const char * path, struct sockaddr_un * addr)
+{
+   struct stat st;
+   int fd, live;
+
+   if (lstat(path, &st) < 0)
+      return errno == ENOENT;
+
+   if (!S_ISSOCK(st.st_mode))
+      return 0;
+
+   fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   live = fd >= 0 && connect(fd, (struct sockaddr *) addr, sizeof(*addr)) == 0;
+   if (fd >= 0)
+      close(fd);
+
+   return !live && unlink(path) == 0;
+}
+
+/*
+   Accept connections forever, running each session in a child forked
+   from the fully initialised server. A child has its own copy of every
+   table, so nothing one session does is seen by another, and the
+   connection is its stdin, stdout and stderr.
+*/
+void serve(const char * path, session_fn session)
+{
+   struct sockaddr_un addr;
+   int fd, conn;
+   pid_t pid;
+
+   if (strlen(path) >= sizeof(addr.sun_path))
+   {
+      fprintf(stderr, "Socket path too long\n");
+      exit(1);
+   }
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   /* finished sessions are reaped automatically */
+   signal(SIGCHLD, SIG_IGN);
+
+   if (!server_clear(path, &addr))
+   {
+      fprintf(stderr, "%s is in use\n", path);
+      exit(1);
+   }
+
+   fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+   if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+      || listen(fd, SERVER_BACKLOG) < 0)
+   {
+      perror(path);
+      exit(1);
+   }
+
+   while (1)
+   {
+      if ((conn = accept(fd, NULL, NULL)) < 0)
+      {
+         if (errno != EINTR)
+            perror("accept");
+         continue;
+      }
+
+      if ((pid = fork()) == 0)
+      {
+         close(fd);
+
+         dup2(conn, 0);
+         dup2(conn, 1);
+         dup2(conn, 2);
+         close(conn);
+
+         session();
+
+         exit(0);
+      }
+
+      if (pid < 0)
+         perror("fork");
+
+      close(conn);
+   }
+}
@@ -0,0 +1,210 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "spec.h"
+
+int spec_limit = SPEC_LIMIT;
+
+void spec_init(void)
+{
+   char * limit = getenv("CESIUM_SPEC_LIMIT");
+
+   if (limit)
+      spec_limit = atoi(limit);
+}
+
+/*
+   Record that the body of an instance relies on the current binding of
+   a global, so that the body is remade if the global is redefined.
+*/
+void spec_depend(inst_t * inst, sym_t * sym)
+{
+   int i;
+
+   for (i = 0; i < inst->num_deps; i++)
+      if (inst->deps[i] == sym)
+         return;
+
+   inst->deps = (sym_t **) GC_REALLOC(inst->deps, (i + 1)*sizeof(sym_t *));
+   inst->versions = (long *) GC_REALLOC(inst->versions, (i + 1)*sizeof(long));
+   inst->deps[i] = sym;
+   inst->versions[i] = sym->version;
+   inst->num_deps++;
+}
+
+int spec_current(inst_t * inst)
+{
+   int i;
+
+   for (i = 0; i < inst->num_deps; i++)
+      if (inst->deps[i]->version != inst->versions[i])
+         return 0;
+
+   return 1;
+}
+
+/*
+   Work out the static type of a node in a body specialised to the
+   given argument types. Returns NULL if the type is not known.
+*/
+type_t * spec_type(ast_t * ast, inst_t * inst, int arity)
+{
+   switch (ast->typ)
+   {
+   case T_INT:
+      return t_int;
+   case T_IDENT:
+      if (ast->loc == LOC_LOCAL && ast->slot < arity)
+         return inst->args[ast->slot];
+      if (ast->loc == LOC_GLOBAL && ast->sym->val.type == t_int)
+      {
+         spec_depend(inst, ast->sym);
+         return t_int;
+      }
+      return NULL;
+   case T_LIST:
+      return ast->child->type;
+   case T_IF:
+      if (ast->child->next->type == ast->child->next->next->type)
+         return ast->child->next->type;
+      return NULL;
+   case T_ADD:
+   case T_SUB:
+   case T_MUL:
+   case T_DIV:
+   case T_REM:
+      if (ast->child->type == t_int && ast->child->next->type == t_int)
+         return t_int;
+      return NULL;
+   default:
+      return NULL;
+   }
+}
+
+ast_t * spec_copy(ast_t * ast, inst_t * inst, int arity)
+{
+   ast_t * a = new_ast();
+   ast_t * c, ** ptr;
+
+   *a = *ast;
+   a->next = NULL;
+
+   /* 
+      nested lambdas are specialised separately, when called, sharing
+      one set of instances between all copies
+   */
+   if (ast->typ == T_LAMBDA)
+   {
+      if (ast->spec == NULL)
+         ast->spec = (spec_t *) GC_MALLOC(sizeof(spec_t));
+      a->spec = ast->spec;
+      return a;
+   }
+
+   ptr = &a->child;
+   for (c = ast->child; c; c = c->next)
+   {
+      *ptr = spec_copy(c, inst, arity);
+      ptr = &((*ptr)->next);
+   }
+
+   a->type = spec_type(a, inst, arity);
+
+   return a;
+}
+
+inst_t * spec_find(spec_t * spec, type_t ** args, int arity)
+{
+   inst_t * inst;
+   int i;
+
+   for (inst = spec->insts; inst; inst = inst->next)
+   {
+      for (i = 0; i < arity; i++)
+         if (!type_equal(inst->args[i], args[i]))
+            break;
+
+      if (i == arity)
+         return inst;
+   }
+
+   return NULL;
+}
+
+inst_t * spec_insert(spec_t * spec, type_t ** args, int arity)
+{
+   inst_t * inst = (inst_t *) GC_MALLOC(sizeof(inst_t));
+   int i;
+
+   inst->args = (type_t **) GC_MALLOC(arity*sizeof(type_t *));
+   for (i = 0; i < arity; i++)
+      inst->args[i] = args[i];
+
+   inst->next = spec->insts;
+   spec->insts = inst;
+   spec->num_insts++;
+
+   return inst;
+}
+
+/*
+   Return the body of the given lambda specialised to the runtime types
+   of the given arguments, making a new instance if needed. Once there
+   are spec_limit instances the generic body is used instead. A body
+   relying on a global which has since been redefined is remade.
+*/
+ast_t * specialise(ast_t * lambda, value_t * args)
+{
+   spec_t * spec = lambda->spec;
+   int arity = lambda->val.type->arity;
+   type_t ** types = (type_t **) alloca(arity*sizeof(type_t *));
+   inst_t * inst;
+   int i;
+
+   for (i = 0; i < arity; i++)
+      types[i] = args[i].type;
+
+   if (spec == NULL)
+   {
+      spec = (spec_t *) GC_MALLOC(sizeof(spec_t));
+      lambda->spec = spec;
+   }
+
+   if (inst = spec_find(spec, types, arity))
+   {
+      if (spec_current(inst))
+         return inst->body;
+
+      inst->num_deps = 0;
+   } else if (spec->num_insts >= spec_limit)
+      return lambda->child->next;
+   else
+      inst = spec_insert(spec, types, arity);
+
+   inst->body = spec_copy(lambda->child->next, inst, arity);
+
+   return inst->body;
+}
@@ -0,0 +1,60 @@
+/*
+
+Copyright 2012 William Hart. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY William Hart ``AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL William Hart OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdlib.h>
+#include <alloca.h>
+#include "ast.h"
+#include "types.h"
+#include "gc.h"
+
+#ifndef SPEC_H
+#define SPEC_H
+
+#define SPEC_LIMIT 8
+
+typedef struct inst_t
+{
+   type_t ** args; /* concrete type arguments */
+   ast_t * body; /* specialised body */
+   sym_t ** deps; /* globals whose types the body relies on */
+   long * versions; /* their versions when the body was made */
+   int num_deps;
+   struct inst_t * next;
+} inst_t;
+
+typedef struct spec_t
+{
+   inst_t * insts; /* instances, most recent first */
+   int num_insts;
+} spec_t;
+
+extern int spec_limit;
+
+void spec_init(void);
+
+ast_t * specialise(ast_t * lambda, value_t * args);
+
+#endif
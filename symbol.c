@@ -26,17 +26,29 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "symbol.h"
 
-sym_t ** sym_tab;
+sym_tab_t * sym_tab;
+
+int sym_count; /* symbols in sym_tab, changed only under sym_lock */
+
+pthread_mutex_t sym_lock = PTHREAD_MUTEX_INITIALIZER;
+
+sym_tab_t * new_sym_tab(int size)
+{
+    sym_tab_t * tab = (sym_tab_t *) ALLOC(TAG_SYMBOL, 
+                               sizeof(sym_tab_t) + size*sizeof(sym_t *));
+    tab->size = size;
+    return tab;
+}
 
 void sym_tab_init(void)
 {
-    sym_tab = (sym_t **) GC_MALLOC(SYM_TAB_SIZE*sizeof(sym_t *));
+    sym_tab = new_sym_tab(SYM_TAB_SIZE);
 }
 
 sym_t * new_symbol(const char * name, int length)
 {
-   sym_t * sym = (sym_t *) GC_MALLOC(sizeof(sym_t));
-   sym->name = (char *) GC_MALLOC(length + 1);
+   sym_t * sym = (sym_t *) ALLOC(TAG_SYMBOL, sizeof(sym_t));
+   sym->name = (char *) ALLOC(TAG_SYMBOL, length + 1);
    strcpy(sym->name, name);
    return sym;
 }
@@ -44,37 +56,98 @@ sym_t * new_symbol(const char * name, int length)
 void print_sym_tab(void)
 {
     int i;
-    for (i = 0; i < SYM_TAB_SIZE; i++)
-        if (sym_tab[i])
-            printf("%s\n", sym_tab[i]->name);
+    for (i = 0; i < sym_tab->size; i++)
+        if (sym_tab->syms[i])
+            printf("%s\n", sym_tab->syms[i]->name);
 }
 
-int sym_hash(const char * name, int length)
+/* FNV-1a, as the table may grow far beyond the range of a simple sum */
+unsigned int sym_hash(const char * name, int length)
 {
-    int hash = (int) name[0];
+    const unsigned char * s = (const unsigned char *) name;
+    unsigned int hash = 2166136261U;
     int i;
-    for (i = 1; i < length; i++)
-        hash += (name[i] << ((3*i) % 15));
-    return hash % SYM_TAB_SIZE;
+    for (i = 0; i < length; i++)
+    {
+        hash ^= s[i];
+        hash *= 16777619U;
+    }
+    return hash;
 }
 
+/*
+   Double the size of the table once it is half full. Must be called
+   with sym_lock held. The new table is filled before it is published,
+   and the old one is left intact for lookups already under way.
+*/
+void sym_tab_grow(void)
+{
+    sym_tab_t * tab = new_sym_tab(2*sym_tab->size);
+    unsigned int hash;
+    sym_t * sym;
+    int i;
+
+    for (i = 0; i < sym_tab->size; i++)
+    {
+        if (sym = sym_tab->syms[i])
+        {
+            hash = sym_hash(sym->name, strlen(sym->name)) % tab->size;
+            while (tab->syms[hash])
+                hash = (hash + 1) % tab->size;
+            tab->syms[hash] = sym;
+        }
+    }
+
+    __atomic_store_n(&sym_tab, tab, __ATOMIC_RELEASE);
+}
+
+/*
+   Lookups of existing symbols take no lock. Entries are only ever
+   added, at the first free slot, and are published once complete, so
+   a thread which misses need only resume probing under the lock. If
+   the table has been replaced meanwhile, probing starts again in the
+   new one.
+*/
 sym_t * sym_lookup(const char * name)
 {
    int length = strlen(name);
-   int hash = sym_hash(name, length);
+   unsigned int h = sym_hash(name, length);
+   sym_tab_t * tab = __atomic_load_n(&sym_tab, __ATOMIC_ACQUIRE);
+   unsigned int hash = h % tab->size;
    sym_t * sym;
 
-   while (sym_tab[hash])
+   while (sym = __atomic_load_n(&tab->syms[hash], __ATOMIC_ACQUIRE))
+   {
+       if (strcmp(sym->name, name) == 0)
+           return sym;
+       hash = (hash + 1) % tab->size;
+   }
+
+   pthread_mutex_lock(&sym_lock);
+
+   if (tab != sym_tab)
+   {
+       tab = sym_tab;
+       hash = h % tab->size;
+   }
+
+   while (sym = tab->syms[hash])
    {
-       if (strcmp(sym_tab[hash]->name, name) == 0)
-           return sym_tab[hash];
-       hash++;
-       if (hash == SYM_TAB_SIZE)
-           hash = 0;
+       if (strcmp(sym->name, name) == 0)
+       {
+           pthread_mutex_unlock(&sym_lock);
+           return sym;
+       }
+       hash = (hash + 1) % tab->size;
    }
 
    sym = new_symbol(name, length);
-   sym_tab[hash] = sym;
+   __atomic_store_n(&tab->syms[hash], sym, __ATOMIC_RELEASE);
+
+   if (2*++sym_count >= tab->size)
+       sym_tab_grow();
+
+   pthread_mutex_unlock(&sym_lock);
+
    return sym;
 }
-
@@ -26,17 +26,27 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 #include "gc.h"
+#include "alloc.h"
+#include "value.h"
 
 #ifndef SYMBOL_H
 #define SYMBOL_H
 
-#define SYM_TAB_SIZE 10000
+#define SYM_TAB_SIZE 10000 /* initial size, doubled as the table fills */
 
 typedef struct sym_t {
    char * name;
+   value_t val; /* global binding, type NULL if unbound */
+   long version; /* number of times global has been (re)defined, see spec.c */
 } sym_t;
 
+typedef struct sym_tab_t {
+   int size;
+   sym_t * syms[]; /* open addressing, NULL if free */
+} sym_tab_t;
+
 void sym_tab_init(void);
 
 void print_sym_tab(void);
@@ -35,7 +35,7 @@ type_t * t_char;
 
 type_t * new_type(typ_t typ)
 {
-   type_t * t = (type_t *) GC_MALLOC(sizeof(type_t));
+   type_t * t = (type_t *) ALLOC(TAG_TYPES, sizeof(type_t));
    t->typ = typ;
    return t;
 }
@@ -54,9 +54,9 @@ type_t * fn_type(type_t * ret, int arity, type_t ** args)
 {
    int i;
    
-   type_t * t = (type_t *) GC_MALLOC(sizeof(type_t));
+   type_t * t = (type_t *) ALLOC(TAG_TYPES, sizeof(type_t));
    t->typ = FN;
-   t->args = (type_t **) GC_MALLOC(sizeof(type_t *)*arity);
+   t->args = (type_t **) ALLOC(TAG_TYPES, sizeof(type_t *)*arity);
    t->ret = ret;
    t->arity = arity;
    
@@ -70,9 +70,9 @@ type_t * tuple_type(int arity, type_t ** args)
 {
    int i;
    
-   type_t * t = (type_t *) GC_MALLOC(sizeof(type_t));
+   type_t * t = (type_t *) ALLOC(TAG_TYPES, sizeof(type_t));
    t->typ = TUPLE;
-   t->args = (type_t **) GC_MALLOC(sizeof(type_t *)*arity);
+   t->args = (type_t **) ALLOC(TAG_TYPES, sizeof(type_t *)*arity);
    t->arity = arity;
 
    for (i = 0; i < arity; i++)
@@ -86,10 +86,10 @@ type_t * data_type(int arity, type_t ** args, sym_t * sym,
 {
    int i;
    
-   type_t * t = (type_t *) GC_MALLOC(sizeof(type_t));
+   type_t * t = (type_t *) ALLOC(TAG_TYPES, sizeof(type_t));
    t->typ = DATATYPE;
-   t->args = (type_t **) GC_MALLOC(sizeof(type_t *)*arity);
-   t->slots = (sym_t **) GC_MALLOC(sizeof(sym_t *)*arity);
+   t->args = (type_t **) ALLOC(TAG_TYPES, sizeof(type_t *)*arity);
+   t->slots = (sym_t **) ALLOC(TAG_TYPES, sizeof(sym_t *)*arity);
    t->arity = arity;
    t->num_params = num_params;
    t->params = params;
@@ -107,10 +107,21 @@ type_t * data_type(int arity, type_t ** args, sym_t * sym,
 
 type_t * array_type(type_t * el_type)
 {
-   type_t * t = (type_t *) GC_MALLOC(sizeof(type_t));
+   /* arrays of base types are unique, so they can be compared by address */
+   static type_t * base_arrays[CHAR + 1];
+   int base = el_type->typ <= CHAR;
+
+   if (base && base_arrays[el_type->typ] 
+            && base_arrays[el_type->typ]->ret == el_type)
+      return base_arrays[el_type->typ];
+
+   type_t * t = (type_t *) ALLOC(TAG_TYPES, sizeof(type_t));
    t->typ = ARRAY;
    t->ret = el_type;
    
+   if (base)
+      base_arrays[el_type->typ] = t;
+
    return t;
 }
 
@@ -125,6 +136,45 @@ type_t * new_typevar(void)
 {
     static long typevarnum = 0;
     type_t * t = new_type(TYPEVAR);
-    t->arity = typevarnum++;
+    t->arity = __sync_fetch_and_add(&typevarnum, 1);
     return t;
 }
+
+int type_equal(type_t * a, type_t * b)
+{
+   int i;
+
+   if (a == b)
+      return 1;
+
+   if (a == NULL || b == NULL || a->typ != b->typ)
+      return 0;
+
+   switch (a->typ)
+   {
+   case FN:
+   case LAMBDA:
+   case TUPLE:
+      if (a->arity != b->arity || !type_equal(a->ret, b->ret))
+         return 0;
+      for (i = 0; i < a->arity; i++)
+         if (!type_equal(a->args[i], b->args[i]))
+            return 0;
+      return 1;
+   case ARRAY:
+      return type_equal(a->ret, b->ret);
+   case GENERIC:
+      return a->sym == b->sym;
+   case DATATYPE:
+      /* instances of the same datatype have the same name and slots */
+      if (a->sym != b->sym || a->arity != b->arity)
+         return 0;
+      for (i = 0; i < a->arity; i++)
+         if (!type_equal(a->args[i], b->args[i]))
+            return 0;
+      return 1;
+   default:
+      /* base types are singletons and typevars are unique */
+      return 0;
+   }
+}
@@ -28,6 +28,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include "symbol.h"
 #include "gc.h"
+#include "alloc.h"
 
 #ifndef TYPES_H
 #define TYPES_H
@@ -48,6 +49,8 @@ typedef struct type_t
    sym_t ** params; /* type parameters */
    struct sym_t * sym; /* name of type */
    struct sym_t ** slots; /* names of type args/slots */
+   struct layout_t * layout; /* memory layout of instances, for datatypes */
+   value_t (*stub)(void *, value_t *); /* call stub, for foreign functions */
 } type_t;
 
 extern type_t * t_nil;
@@ -74,5 +77,7 @@ type_t * fn_to_lambda_type(type_t * type);
 
 type_t * new_typevar(void);
 
+int type_equal(type_t * a, type_t * b);
+
 #endif
 